@@ -0,0 +1,67 @@
+#!/bin/sh
+#
+# Measures heap allocations per request of a myhttpd built with
+# -DCOUNT_ALLOCATIONS (make allocs). The server is warmed up first so caches,
+# pools and buffers are filled, then the allocation counter from
+# /server-status?json is read around a measured loadgen run. Every case is
+# measured on its own and prints one line:
+#   {"case":"default","requests":N,"allocations":M,"per_request":X}
+# Cases are the default loadgen mix of short file paths, a file path too long
+# for std::string's inline buffer and a directory listing. They are served
+# from a scratch document root made of the files next to this script.
+# Reading the status page allocates a little itself, it is not subtracted.
+#
+# Environment: PORT (default 18200), THREADS (default 4), WARMUP and
+# MEASURE (seconds, default 2 and 5), LOADGEN_ARGS (passed to loadgen as is).
+#
+
+PORT=${PORT:-18200}
+THREADS=${THREADS:-4}
+WARMUP=${WARMUP:-2}
+MEASURE=${MEASURE:-5}
+LOADGEN_ARGS=${LOADGEN_ARGS:-"-c 16"}
+LONG_PATH=/assets/stylesheets/application.css
+LISTED_DIR=/sub/
+
+cd "$(dirname "$0")" || exit 1
+for bin in ./myhttpd-allocs ./loadgen; do
+    [ -x "$bin" ] || { echo "$bin is missing, run make allocs first" >&2; exit 1; }
+done
+
+root=$(mktemp -d) || exit 1
+trap 'rm -rf "$root"' EXIT
+cp index.html pic.jpg picS.jpg picL.jpg "$root"
+mkdir -p "$root$(dirname $LONG_PATH)" "$root$LISTED_DIR"
+cp index.html "$root$LONG_PATH"
+cp picS.jpg pic.jpg "$root$LISTED_DIR"
+
+allocations() {
+    curl -s "http://127.0.0.1:$PORT/server-status?json" | sed -n 's/.*"allocations":\([0-9]*\).*/\1/p'
+}
+
+# measure <case> [loadgen options]
+measure() {
+    name=$1
+    shift
+    ./loadgen -p "$PORT" -d "$WARMUP" "$@" $LOADGEN_ARGS > /dev/null
+    before=$(allocations)
+    requests=$(./loadgen -p "$PORT" -d "$MEASURE" "$@" $LOADGEN_ARGS | sed -n 's/.*"requests":\([0-9]*\).*/\1/p')
+    after=$(allocations)
+    if [ -z "$before" ] || [ -z "$after" ] || [ -z "$requests" ]; then
+        echo "measurement of $name failed" >&2
+        failed=1
+        return
+    fi
+    awk -v c="$name" -v r="$requests" -v a="$((after - before))" \
+        'BEGIN { printf "{\"case\":\"%s\",\"requests\":%d,\"allocations\":%d,\"per_request\":%.3f}\n", c, r, a, r ? a / r : 0 }'
+}
+
+./myhttpd-allocs -p "$PORT" -t 0 -n "$THREADS" -r "$root"
+sleep 1
+pid=$(pgrep -n -f "myhttpd-allocs -p $PORT ")
+failed=0
+measure default
+measure long-path -m "$LONG_PATH:1"
+measure directory -m "$LISTED_DIR:1"
+[ -n "$pid" ] && kill "$pid"
+exit $failed
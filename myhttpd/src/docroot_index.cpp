@@ -0,0 +1,200 @@
+#include "docroot_index.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <dirent.h>
+#include <unistd.h>
+
+
+/* Builds the index of given roots and starts watching them. Returns false if inotify can't be used */
+bool docroot_index::open(const std::vector<std::string> & roots) {
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1) return false;
+    hold h(&this->lock, true);
+    this->inotify_fd = fd;
+    this->roots = roots;
+    for (const std::string & root : this->roots) {
+        this->add_tree(root + "/");
+        if (this->inotify_fd == -1) return false;
+    }
+    return true;
+}
+
+/*
+ * Same contract as stat(). Paths under indexed roots are answered from memory,
+ * others, and those below a symbolic link, go to the file system.
+ */
+int docroot_index::stat_path(const std::string & path, struct stat * st) {
+    if (this->inotify_fd == -1 || !this->covers(path)) return stat(path.c_str(), st);
+    /* Other spellings of the key are built in a buffer the thread keeps, so lookups don't allocate */
+    static thread_local std::string scratch;
+    bool linked = false;
+    {
+        hold h(&this->lock, false);
+        /* Index may have been given up, and emptied, since the check above */
+        if (this->inotify_fd != -1) {
+            auto it = this->entries.find(path);
+            if (it == this->entries.end() && path.back() == '/') {
+                scratch.assign(path, 0, path.length() - 1);
+                it = this->entries.find(scratch);
+            }
+            if (it != this->entries.end()) {
+                *st = it->second.st;
+                return 0;
+            }
+            /* Missing path is known to be absent unless its nearest indexed ancestor is a link */
+            for (size_t slash = path.rfind('/', path.length() - 2); slash != std::string::npos && slash > 0;
+                 slash = path.rfind('/', slash - 1)) {
+                scratch.assign(path, 0, slash);
+                auto parent = this->entries.find(scratch);
+                if (parent == this->entries.end()) continue;
+                linked = parent->second.linked;
+                break;
+            }
+            if (!linked) {
+                errno = ENOENT;
+                return -1;
+            }
+        }
+    }
+    return stat(path.c_str(), st);
+}
+
+size_t docroot_index::size() {
+    hold h(&this->lock, false);
+    return this->entries.size();
+}
+
+/* Applies queued inotify events. Called by the reactor when the descriptor becomes readable */
+void docroot_index::process_events() {
+    alignas(struct inotify_event) char buf[DOCROOT_EVENT_BUFFER];
+    bool overflow = false;
+    ssize_t n;
+    hold h(&this->lock, true);
+    while (this->inotify_fd != -1 && (n = read(this->inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char * p = buf; p < buf + n; ) {
+            struct inotify_event * ev = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) overflow = true;
+            auto w = this->watches.find(ev->wd);
+            if (overflow || w == this->watches.end()) continue;
+            if (ev->mask & IN_IGNORED) {
+                this->watches.erase(w);
+                continue;
+            }
+            std::string dir = w->second;
+            if (ev->len) {
+                std::string child = child_path(dir, ev->name);
+                if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) this->remove_tree(child);
+                else if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_CREATE | IN_MOVED_TO))) this->add_tree(child);
+                else this->refresh(child);
+            }
+            /* Directory's own mtime and size change with its content */
+            this->refresh(dir);
+        }
+    }
+    /* Events were lost, nothing short of a full scan can be trusted */
+    if (overflow) this->rebuild();
+}
+
+/* Indexes path and, for a real directory, everything below it. Caller holds the lock */
+void docroot_index::add_tree(const std::string & path) {
+    struct stat lst, st;
+    if (lstat(path.c_str(), &lst) == -1 || stat(path.c_str(), &st) == -1) return;
+    entry & e = this->entries[path];
+    e.st = st;
+    e.linked = S_ISLNK(lst.st_mode);
+    if (!S_ISDIR(lst.st_mode)) return;
+    /* Watch goes first so nothing created while the directory is read is missed */
+    int wd = inotify_add_watch(this->inotify_fd, path.c_str(), DOCROOT_WATCH_MASK);
+    if (wd == -1) {
+        std::cerr << "document root index disabled, cannot watch " << path << ": " << strerror(errno) << "\n";
+        this->disable();
+        return;
+    }
+    /* Directory already watched under another name is treated like a link */
+    auto w = this->watches.find(wd);
+    if (w != this->watches.end() && w->second != path) {
+        e.linked = true;
+        return;
+    }
+    this->watches[wd] = path;
+    DIR * dir = opendir(path.c_str());
+    if (!dir) return;
+    std::vector<std::string> children;
+    struct dirent * de;
+    while ((de = readdir(dir))) {
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) continue;
+        children.push_back(child_path(path, de->d_name));
+    }
+    closedir(dir);
+    for (const std::string & child : children) {
+        this->add_tree(child);
+        if (this->inotify_fd == -1) return;
+    }
+}
+
+/* Gives the index up, lookups go to stat() from now on. Caller holds the exclusive lock */
+void docroot_index::disable() {
+    int fd = this->inotify_fd.exchange(-1);
+    if (fd != -1) close(fd);
+    this->entries.clear();
+    this->watches.clear();
+}
+
+/* Re-reads attributes of a single path. Caller holds the lock */
+void docroot_index::refresh(const std::string & path) {
+    struct stat lst, st;
+    if (lstat(path.c_str(), &lst) == -1 || stat(path.c_str(), &st) == -1) {
+        this->remove_tree(path);
+        return;
+    }
+    auto it = this->entries.find(path);
+    if (it == this->entries.end() && S_ISDIR(lst.st_mode)) {
+        this->add_tree(path);
+        return;
+    }
+    entry & e = this->entries[path];
+    e.st = st;
+    e.linked = S_ISLNK(lst.st_mode);
+}
+
+/* Forgets path and everything below it. Caller holds the lock */
+void docroot_index::remove_tree(const std::string & path) {
+    std::string prefix = path + "/";
+    for (auto it = this->entries.begin(); it != this->entries.end(); ) {
+        if (it->first == path || !it->first.compare(0, prefix.size(), prefix)) it = this->entries.erase(it);
+        else ++it;
+    }
+    /* Directory moved away keeps its watch, under the old name it would report wrong paths */
+    for (auto it = this->watches.begin(); it != this->watches.end(); ) {
+        if (it->second == path || !it->second.compare(0, prefix.size(), prefix)) {
+            inotify_rm_watch(this->inotify_fd, it->first);
+            it = this->watches.erase(it);
+        }
+        else ++it;
+    }
+}
+
+void docroot_index::rebuild() {
+    for (auto & w : this->watches) inotify_rm_watch(this->inotify_fd, w.first);
+    this->watches.clear();
+    this->entries.clear();
+    for (const std::string & root : this->roots) {
+        this->add_tree(root + "/");
+        if (this->inotify_fd == -1) return;
+    }
+}
+
+/* Root is "<root>/" itself or anything below it */
+bool docroot_index::covers(const std::string & path) const {
+    for (const std::string & root : this->roots)
+        if (path.size() > root.size() && !path.compare(0, root.size(), root) && path[root.size()] == '/')
+            return true;
+    return false;
+}
+
+std::string docroot_index::child_path(const std::string & dir, const char * name) {
+    return dir.back() == '/' ? dir + name : dir + "/" + name;
+}
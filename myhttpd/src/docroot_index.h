@@ -0,0 +1,70 @@
+#ifndef DOCROOT_INDEX_H
+#define DOCROOT_INDEX_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <pthread.h>
+
+/* Size of the buffer inotify events are read into */
+#define DOCROOT_EVENT_BUFFER                65536
+/* Everything that can change what stat() returns for a directory or its entries */
+#define DOCROOT_WATCH_MASK                  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                                             IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_ONLYDIR)
+
+/*
+ * In-memory copy of stat() for every path under the served roots, kept
+ * current with inotify. Paths are keyed the way normalize_path() builds them:
+ * root itself is "<root>/", anything below is "<root>/a/b" without trailing slash.
+ *
+ * Only real directories are descended into. A path below a symbolic link to
+ * a directory is not in the index and is answered by stat() instead.
+ *
+ * Every request looks paths up from its shard, so lookups share a read lock
+ * and only applying events takes it exclusively.
+ */
+class docroot_index {
+public:
+    docroot_index() { pthread_rwlock_init(&this->lock, NULL); }
+    ~docroot_index() { pthread_rwlock_destroy(&this->lock); }
+    bool open(const std::vector<std::string> &);
+    int fd() const { return this->inotify_fd.load(); }
+    void process_events();
+    int stat_path(const std::string &, struct stat *);
+    size_t size();
+private:
+    struct entry {
+        struct stat st;         // of the target when path is a symbolic link
+        bool linked;            // path is a symbolic link
+    };
+    /* Holds the lock shared or exclusive for a scope, C++11 has no shared_mutex */
+    class hold {
+    public:
+        hold(pthread_rwlock_t * lock, bool exclusive) : lock(lock) {
+            if (exclusive) pthread_rwlock_wrlock(lock);
+            else pthread_rwlock_rdlock(lock);
+        }
+        ~hold() { pthread_rwlock_unlock(this->lock); }
+    private:
+        pthread_rwlock_t * lock;
+    };
+    void disable();
+    void add_tree(const std::string &);
+    void refresh(const std::string &);
+    void remove_tree(const std::string &);
+    void rebuild();
+    bool covers(const std::string &) const;
+    static std::string child_path(const std::string &, const char *);
+
+    pthread_rwlock_t lock;
+    std::unordered_map<std::string, entry> entries;
+    std::unordered_map<int, std::string> watches;   // watch descriptor -> directory
+    std::vector<std::string> roots;
+    /* Set to -1 under the exclusive lock when the index is given up, readers check it without the lock first */
+    std::atomic<int> inotify_fd{-1};
+};
+
+#endif
@@ -0,0 +1,152 @@
+#include "http_parser.h"
+
+#include <cstring>
+#include <strings.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+
+bool str_ref::equals(const char * s) const {
+    return strlen(s) == this->len && !memcmp(this->data, s, this->len);
+}
+
+bool str_ref::iequals(const char * s) const {
+    return strlen(s) == this->len && !strncasecmp(this->data, s, this->len);
+}
+
+std::ostream & operator<<(std::ostream & out, const str_ref & ref) {
+    return out.write(ref.data, ref.len);
+}
+
+/*
+ * Helper method returns pointer to the first occurrence of c in [p, end) or NULL.
+ * Compares 32 bytes at a time with AVX2 (built with -mavx2) or 16 with SSE2,
+ * the tail and other architectures are scanned byte by byte.
+ */
+const char * find_byte(const char * p, const char * end, char c) {
+#if defined(__AVX2__)
+    const __m256i needle32 = _mm256_set1_epi8(c);
+    while (end - p >= 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)p);
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle32));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i needle16 = _mm_set1_epi8(c);
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle16));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    for (; p < end; p++)
+        if (*p == c) return p;
+    return NULL;
+}
+
+/* Helper method checks whether character may appear in a method or header name (RFC 7230, 3.2.6) */
+static bool is_tchar(unsigned char c) {
+    if (c >= '0' && c <= '9') return true;
+    if ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') return true;
+    return c && strchr("!#$%&'*+-.^_`|~", c);
+}
+
+void http_parser::reset() {
+    this->state = REQUEST_LINE;
+    this->pos = this->line_start = this->header_len = 0;
+    this->header_count = 0;
+    this->method = this->target = this->version = str_ref();
+}
+
+/*
+ * Consumes complete lines of buf. Returns PARSE_INCOMPLETE when the empty line
+ * terminating header hasn't arrived yet, the next call resumes from that point.
+ */
+parse_result http_parser::parse(const char * buf, size_t len) {
+    while (true) {
+        const char * eol = find_byte(buf + this->pos, buf + len, '\n');
+        if (!eol) {
+            this->pos = len;
+            return PARSE_INCOMPLETE;
+        }
+        size_t start = this->line_start, end = eol - buf;
+        if (end > start && buf[end-1] == '\r') end--;
+        this->pos = this->line_start = eol - buf + 1;
+        if (this->state == REQUEST_LINE) {
+            /* Empty lines before request line are ignored (RFC 7230, 3.5) */
+            if (end == start) continue;
+            if (!this->parse_request_line(buf, start, end)) return PARSE_ERROR;
+            this->state = HEADERS;
+        }
+        else if (end == start) {
+            this->header_len = this->pos;
+            this->bind(buf);
+            return PARSE_DONE;
+        }
+        else if (!this->parse_header_line(buf, start, end)) return PARSE_ERROR;
+    }
+}
+
+/* Splits "method SP request-target SP HTTP-version" */
+bool http_parser::parse_request_line(const char * buf, size_t start, size_t end) {
+    const char * line = buf + start, * stop = buf + end;
+    const char * sp1 = find_byte(line, stop, ' ');
+    if (!sp1 || sp1 == line) return false;
+    const char * sp2 = find_byte(sp1 + 1, stop, ' ');
+    if (!sp2 || sp2 == sp1 + 1) return false;
+    for (const char * c = line; c < sp1; c++)
+        if (!is_tchar(*c)) return false;
+    for (const char * c = sp1 + 1; c < sp2; c++)
+        if ((unsigned char)*c <= ' ' || *c == 0x7f) return false;
+    const char * v = sp2 + 1;
+    if (stop - v != 8 || memcmp(v, "HTTP/", 5) || v[5] < '0' || v[5] > '9' || v[6] != '.' || v[7] < '0' || v[7] > '9')
+        return false;
+    this->method_s = {(uint32_t)start, (uint32_t)(sp1 - line)};
+    this->target_s = {(uint32_t)(sp1 + 1 - buf), (uint32_t)(sp2 - sp1 - 1)};
+    this->version_s = {(uint32_t)(v - buf), 8};
+    return true;
+}
+
+/* Splits "field-name: OWS field-value OWS" */
+bool http_parser::parse_header_line(const char * buf, size_t start, size_t end) {
+    /* Obsolete line folding is rejected (RFC 7230, 3.2.4) */
+    if (buf[start] == ' ' || buf[start] == '\t') return false;
+    if (this->header_count == PARSER_MAX_HEADERS) return false;
+    const char * line = buf + start, * stop = buf + end;
+    const char * colon = find_byte(line, stop, ':');
+    if (!colon || colon == line) return false;
+    for (const char * c = line; c < colon; c++)
+        if (!is_tchar(*c)) return false;
+    const char * v = colon + 1;
+    while (v < stop && (*v == ' ' || *v == '\t')) v++;
+    while (stop > v && (stop[-1] == ' ' || stop[-1] == '\t')) stop--;
+    this->names[this->header_count] = {(uint32_t)start, (uint32_t)(colon - line)};
+    this->values[this->header_count] = {(uint32_t)(v - buf), (uint32_t)(stop - v)};
+    this->header_count++;
+    return true;
+}
+
+/* Turns offsets into references once the buffer won't move anymore */
+void http_parser::bind(const char * buf) {
+    this->method = str_ref(buf + this->method_s.off, this->method_s.len);
+    this->target = str_ref(buf + this->target_s.off, this->target_s.len);
+    this->version = str_ref(buf + this->version_s.off, this->version_s.len);
+    for (int i=0; i<this->header_count; i++) {
+        this->headers[i].name = str_ref(buf + this->names[i].off, this->names[i].len);
+        this->headers[i].value = str_ref(buf + this->values[i].off, this->values[i].len);
+    }
+}
+
+/* Returns value of the first header field with given name (case-insensitive) or empty reference */
+str_ref http_parser::header(const char * name) const {
+    for (int i=0; i<this->header_count; i++)
+        if (this->headers[i].name.iequals(name)) return this->headers[i].value;
+    return str_ref();
+}
@@ -0,0 +1,71 @@
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <ostream>
+
+/* Parser limits */
+#define PARSER_MAX_HEADERS                  32
+
+/* Reference to a part of connection's input buffer. Not NUL-terminated */
+struct str_ref {
+    const char * data;
+    size_t len;
+    str_ref() : data(NULL), len(0) {}
+    str_ref(const char * d, size_t l) : data(d), len(l) {}
+    bool empty() const { return len == 0; }
+    bool equals(const char *) const;
+    bool iequals(const char *) const;
+    std::string str() const { return std::string(data, len); }
+};
+
+std::ostream & operator<<(std::ostream &, const str_ref &);
+
+struct http_header {
+    str_ref name, value;
+};
+
+enum parse_result {
+    PARSE_INCOMPLETE,
+    PARSE_DONE,
+    PARSE_ERROR
+};
+
+/*
+ * Resumable request header parser. It is fed the whole unconsumed input buffer
+ * every time new bytes arrive and continues from the line where it stopped.
+ * Nothing is copied or allocated: once parsing is done request line and header
+ * fields are references into the buffer, valid as long as the buffer is untouched.
+ */
+class http_parser {
+public:
+    http_parser() { reset(); }
+    void reset();
+    parse_result parse(const char *, size_t);
+    /* Length of the header including the terminating empty line */
+    size_t length() const { return this->header_len; }
+    str_ref header(const char *) const;
+
+    str_ref method, target, version;
+    http_header headers[PARSER_MAX_HEADERS];
+    int header_count;
+private:
+    /* Offsets are kept while parsing because the buffer may be reallocated between calls */
+    struct span {
+        uint32_t off, len;
+    };
+    bool parse_request_line(const char *, size_t, size_t);
+    bool parse_header_line(const char *, size_t, size_t);
+    void bind(const char *);
+
+    enum { REQUEST_LINE, HEADERS } state;
+    size_t pos, line_start, header_len;
+    span method_s, target_s, version_s;
+    span names[PARSER_MAX_HEADERS], values[PARSER_MAX_HEADERS];
+};
+
+const char * find_byte(const char *, const char *, char);
+
+#endif
@@ -0,0 +1,324 @@
+
+#include "loadgen.h"
+
+
+std::vector<lg_target> targets;
+int total_weight = 0;
+lg_clock::time_point start_time, end_time;
+
+
+void print_usage(const char * exec) {
+    std::cout   << "\nUSAGE: " << exec << " [Options]\n\n"
+                << "Drives myhttpd on the loopback interface and prints results as JSON.\n\n"
+                << "Options:\n" << "\t-h\t\tPrint a usage summary;\n"
+                << "\t-p <port>\tPort of the server on 127.0.0.1. Default: 8080;\n"
+                << "\t-c <clients>\tNumber of concurrent connections, one thread each. Default: 16;\n"
+                << "\t-d <time>\tDuration of the run in seconds. Default: 10;\n"
+                << "\t-r <rate>\tOpen loop: total requests per second, latency counts from the\n"
+                << "\t\t\tscheduled send time. Default: 0, closed loop;\n"
+                << "\t-m <mix>\tComma separated path:weight list. Default: " LOADGEN_DEFAULT_MIX ";\n"
+                << "\t-C\t\tOpen a new connection for every request;\n\n";
+    exit(0);
+}
+
+void parse_args(int ac, char * av[]) {
+    const char * exec_name = av[0];
+    try {
+        for(int i=1; i<ac; i++) {
+            std::string current = av[i];
+            if (current.size() != 2 || current[0] != '-') print_usage(exec_name);
+            switch (current[1]) {
+                case 'p':
+                if (++i >= ac) print_usage(exec_name);
+                lg_params.port = av[i];
+                break;
+                case 'c':
+                if (++i >= ac) print_usage(exec_name);
+                lg_params.clients = std::stoi(av[i]);
+                break;
+                case 'd':
+                if (++i >= ac) print_usage(exec_name);
+                lg_params.duration = std::stoi(av[i]);
+                break;
+                case 'r':
+                if (++i >= ac) print_usage(exec_name);
+                lg_params.rate = std::stod(av[i]);
+                break;
+                case 'm':
+                if (++i >= ac) print_usage(exec_name);
+                lg_params.mix = av[i];
+                break;
+                case 'C':
+                lg_params.keep_alive = false;
+                break;
+                default:
+                print_usage(exec_name);
+            }
+        }
+    }
+    catch (const std::exception &) {
+        print_usage(exec_name);
+    }
+    if (lg_params.clients < 1 || lg_params.duration < 1 || lg_params.rate < 0) print_usage(exec_name);
+}
+
+/* Builds complete request for every path:weight item of the mix */
+void parse_mix(const std::string & mix, std::vector<lg_target> & out) {
+    size_t pos = 0;
+    while (pos <= mix.size()) {
+        size_t end = mix.find(',', pos);
+        if (end == std::string::npos) end = mix.size();
+        std::string item = mix.substr(pos, end - pos);
+        pos = end + 1;
+        if (item.empty()) continue;
+        lg_target t;
+        t.weight = 1;
+        size_t colon = item.rfind(':');
+        if (colon != std::string::npos) {
+            t.weight = atoi(item.c_str() + colon + 1);
+            item.erase(colon);
+        }
+        if (t.weight <= 0) continue;
+        if (item.empty() || item[0] != '/') item.insert(0, "/");
+        t.request = "GET " + item + " HTTP/1.1\r\nHost: 127.0.0.1\r\n";
+        if (!lg_params.keep_alive) t.request += "Connection: close\r\n";
+        t.request += "\r\n";
+        total_weight += t.weight;
+        out.push_back(t);
+    }
+    if (out.empty()) {
+        std::cerr << "empty request mix\n";
+        exit(1);
+    }
+}
+
+bool lg_connect(lg_connection & conn) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(atoi(lg_params.port.c_str()));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if ((conn.fd = socket(AF_INET, SOCK_STREAM, 0)) == -1) return false;
+    struct timeval tv = {LOADGEN_IO_TIMEOUT, 0};
+    int y = 1;
+    setsockopt(conn.fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &y, sizeof(y));
+    if (connect(conn.fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        lg_close(conn);
+        return false;
+    }
+    return true;
+}
+
+void lg_close(lg_connection & conn) {
+    if (conn.fd != -1) close(conn.fd);
+    conn.fd = -1;
+    conn.in.clear();
+}
+
+/* Appends whatever arrived to the input buffer. Returns recv() result */
+ssize_t fill(lg_connection & conn) {
+    char buf[LOADGEN_READ_SIZE];
+    ssize_t n;
+    while ((n = recv(conn.fd, buf, sizeof(buf), 0)) == -1 && errno == EINTR);
+    if (n > 0) conn.in.append(buf, n);
+    return n;
+}
+
+/* Discards n bytes of body without keeping them in the input buffer */
+bool skip(lg_connection & conn, uint64_t n) {
+    size_t buffered = std::min<uint64_t>(n, conn.in.size());
+    conn.in.erase(0, buffered);
+    n -= buffered;
+    char buf[LOADGEN_READ_SIZE];
+    while (n) {
+        ssize_t got = recv(conn.fd, buf, std::min<uint64_t>(n, sizeof(buf)), 0);
+        if (got == -1 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        n -= got;
+    }
+    return true;
+}
+
+bool send_request(lg_connection & conn, const std::string & request) {
+    size_t sent = 0;
+    while (sent < request.size()) {
+        ssize_t n = send(conn.fd, request.data() + sent, request.size() - sent, MSG_NOSIGNAL);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+/*
+ * Reads one response. Body is delimited by Content-Length, chunked encoding
+ * or end of the connection, which is reported through closed.
+ */
+bool read_response(lg_connection & conn, int & status, uint64_t & bytes, bool & closed) {
+    size_t head_end;
+    while ((head_end = conn.in.find("\r\n\r\n")) == std::string::npos)
+        if (fill(conn) <= 0) return false;
+    if (head_end < 12 || conn.in.compare(0, 5, "HTTP/")) return false;
+    status = atoi(conn.in.c_str() + 9);
+    long long length = -1;
+    bool chunked = false;
+    closed = false;
+    size_t line = conn.in.find("\r\n") + 2;
+    while (line < head_end) {
+        size_t next = conn.in.find("\r\n", line);
+        const char * l = conn.in.c_str() + line;
+        std::string value = conn.in.substr(line, next - line);
+        if (!strncasecmp(l, "Content-Length:", 15)) length = atoll(l + 15);
+        else if (!strncasecmp(l, "Transfer-Encoding:", 18)) chunked = value.find("chunked") != std::string::npos;
+        else if (!strncasecmp(l, "Connection:", 11)) closed = value.find("close") != std::string::npos;
+        line = next + 2;
+    }
+    conn.in.erase(0, head_end + 4);
+    bytes = 0;
+    if (length >= 0) {
+        bytes = length;
+        return skip(conn, length);
+    }
+    if (chunked) {
+        while (true) {
+            size_t eol;
+            while ((eol = conn.in.find("\r\n")) == std::string::npos)
+                if (fill(conn) <= 0) return false;
+            unsigned long size = strtoul(conn.in.c_str(), NULL, 16);
+            conn.in.erase(0, eol + 2);
+            /* Chunk data is followed by CRLF, the last chunk by an empty trailer */
+            if (!skip(conn, size)) return false;
+            while (conn.in.size() < 2)
+                if (fill(conn) <= 0) return false;
+            conn.in.erase(0, 2);
+            bytes += size;
+            if (!size) return true;
+        }
+    }
+    /* Body ends with the connection */
+    ssize_t n;
+    while ((n = fill(conn)) > 0) {
+        bytes += conn.in.size();
+        conn.in.clear();
+    }
+    closed = true;
+    return n == 0;
+}
+
+/* Picks a request of the mix with a per-client xorshift generator */
+const lg_target & pick_target(uint64_t & state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    int r = state % total_weight;
+    for (const lg_target & t : targets) {
+        if (r < t.weight) return t;
+        r -= t.weight;
+    }
+    return targets.back();
+}
+
+/*
+ * Closed loop sends the next request as soon as the previous response is read.
+ * Open loop sends on a fixed schedule and measures latency from the scheduled
+ * time, so a slow server is charged for requests that had to wait.
+ */
+void client_thread(int id, lg_stats * st) {
+    lg_connection conn;
+    uint64_t rng = 0x9E3779B97F4A7C15ULL * (id + 1);
+    bool open_loop = lg_params.rate > 0;
+    lg_clock::duration interval(0);
+    if (open_loop)
+        interval = std::chrono::duration_cast<lg_clock::duration>(
+                       std::chrono::duration<double>(lg_params.clients / lg_params.rate));
+    /* Clients are spread over the first interval so they don't fire together */
+    lg_clock::time_point next = start_time + interval * id / lg_params.clients;
+    while (true) {
+        lg_clock::time_point issued;
+        if (open_loop) {
+            if (next >= end_time) break;
+            std::this_thread::sleep_until(next);
+            issued = next;
+            next += interval;
+        }
+        else if ((issued = lg_clock::now()) >= end_time) break;
+        const lg_target & t = pick_target(rng);
+        int status;
+        uint64_t bytes;
+        bool closed, ok = false;
+        /* Server may have closed an idle connection, that request is retried once on a fresh one */
+        for (int attempt=0; attempt<2 && !ok; attempt++) {
+            bool reused = conn.fd != -1;
+            if (!reused) {
+                if (!lg_connect(conn)) break;
+                st->connects++;
+            }
+            ok = send_request(conn, t.request) && read_response(conn, status, bytes, closed);
+            if (!ok) lg_close(conn);
+            if (!reused) break;
+        }
+        if (!ok) {
+            st->errors++;
+            continue;
+        }
+        uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(lg_clock::now() - issued).count();
+        st->latencies.push_back(us > UINT32_MAX ? UINT32_MAX : us);
+        st->status[status]++;
+        st->bytes += bytes;
+        if (closed || !lg_params.keep_alive) lg_close(conn);
+    }
+    lg_close(conn);
+}
+
+/* Nearest-rank percentile of sorted samples */
+uint32_t percentile(const std::vector<uint32_t> & sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.999999);
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+void print_report(const std::vector<lg_stats> & stats, double elapsed) {
+    std::vector<uint32_t> all;
+    std::map<int, uint64_t> status;
+    uint64_t errors = 0, bytes = 0, connects = 0, sum = 0;
+    for (const lg_stats & s : stats) {
+        all.insert(all.end(), s.latencies.begin(), s.latencies.end());
+        for (const std::pair<const int, uint64_t> & c : s.status) status[c.first] += c.second;
+        errors += s.errors;
+        bytes += s.bytes;
+        connects += s.connects;
+    }
+    std::sort(all.begin(), all.end());
+    for (uint32_t l : all) sum += l;
+    printf("{\"clients\":%d,\"mode\":\"%s\",\"rate\":%.1f,\"keep_alive\":%s,\"duration\":%.3f,"
+           "\"requests\":%zu,\"errors\":%llu,\"connections\":%llu,\"bytes\":%llu,"
+           "\"throughput\":%.1f,\"mbytes_per_sec\":%.2f,\"status\":{",
+           lg_params.clients, lg_params.rate > 0 ? "open" : "closed", lg_params.rate,
+           lg_params.keep_alive ? "true" : "false", elapsed, all.size(), (unsigned long long)errors,
+           (unsigned long long)connects, (unsigned long long)bytes, all.size() / elapsed,
+           bytes / elapsed / 1048576.0);
+    const char * sep = "";
+    for (const std::pair<const int, uint64_t> & c : status) {
+        printf("%s\"%d\":%llu", sep, c.first, (unsigned long long)c.second);
+        sep = ",";
+    }
+    printf("},\"latency_us\":{\"min\":%u,\"mean\":%.1f,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"p99.9\":%u,\"max\":%u}}\n",
+           all.empty() ? 0 : all.front(), all.empty() ? 0.0 : (double)sum / all.size(),
+           percentile(all, 50), percentile(all, 90), percentile(all, 99), percentile(all, 99.9),
+           all.empty() ? 0 : all.back());
+}
+
+int main(int argc, char * argv[]) {
+    parse_args(argc, argv);
+    parse_mix(lg_params.mix, targets);
+    std::vector<lg_stats> stats(lg_params.clients);
+    std::vector<std::thread> clients;
+    start_time = lg_clock::now();
+    end_time = start_time + std::chrono::seconds(lg_params.duration);
+    for (int id=0; id<lg_params.clients; id++)
+        clients.push_back(std::thread(client_thread, id, &stats[id]));
+    for (std::thread & t : clients) t.join();
+    print_report(stats, std::chrono::duration<double>(lg_clock::now() - start_time).count());
+    return 0;
+}
@@ -0,0 +1,83 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <map>
+#include <cstring>
+#include <cerrno>
+#include <strings.h>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/* Defaults of the load generator */
+#define LOADGEN_DEFAULT_PORT                "8080"
+#define LOADGEN_DEFAULT_CLIENTS             16
+#define LOADGEN_DEFAULT_DURATION            10
+#define LOADGEN_DEFAULT_MIX                 "/index.html:4,/picS.jpg:2,/pic.jpg:1,/picL.jpg:1,/:1"
+
+/* Response that doesn't arrive in this time counts as an error */
+#define LOADGEN_IO_TIMEOUT                  5
+
+/* Socket read size */
+#define LOADGEN_READ_SIZE                   65536
+
+typedef std::chrono::steady_clock lg_clock;
+
+/* Structure holds parameters of a run */
+static struct lg_parameters {
+    std::string port = LOADGEN_DEFAULT_PORT;
+    int clients = LOADGEN_DEFAULT_CLIENTS;
+    int duration = LOADGEN_DEFAULT_DURATION;
+    double rate = 0;            // requests per second of all clients, 0 is closed loop
+    bool keep_alive = true;
+    std::string mix = LOADGEN_DEFAULT_MIX;
+} lg_params;
+
+/* One entry of the request mix, chosen with probability weight / total */
+struct lg_target {
+    std::string request;        // complete request header
+    int weight;
+};
+
+/* Results of one client, merged after all clients stop */
+struct lg_stats {
+    std::vector<uint32_t> latencies;    // microseconds
+    std::map<int, uint64_t> status;
+    uint64_t errors = 0;
+    uint64_t bytes = 0;
+    uint64_t connects = 0;
+};
+
+/* Client's connection with bytes read past the previous response */
+struct lg_connection {
+    int fd = -1;
+    std::string in;
+};
+
+void print_usage(const char *);
+void parse_args(int, char *[]);
+void parse_mix(const std::string &, std::vector<lg_target> &);
+bool lg_connect(lg_connection &);
+void lg_close(lg_connection &);
+ssize_t fill(lg_connection &);
+bool skip(lg_connection &, uint64_t);
+bool send_request(lg_connection &, const std::string &);
+bool read_response(lg_connection &, int &, uint64_t &, bool &);
+const lg_target & pick_target(uint64_t &);
+void client_thread(int, lg_stats *);
+uint32_t percentile(const std::vector<uint32_t> &, double);
+void print_report(const std::vector<lg_stats> &, double);
+
+#endif
@@ -0,0 +1,375 @@
+#include "microbench.h"
+
+
+/* Representative inputs, every operation cycles through them */
+static const char * const paths[] = {
+    "/index.html", "/picS.jpg", "/img/gallery/2016/photo.jpeg?size=large", "/docs/./guide/../api/index.htm", "/"
+};
+static const char * const methods[] = { "GET", "HEAD", "GET", "POST" };
+static const char * const requests[] = {
+    "GET /index.html HTTP/1.1\r\nHost: 127.0.0.1:8080\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:120.0) "
+    "Gecko/20100101 Firefox/120.0\r\nAccept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\nAccept-Encoding: gzip, deflate\r\nConnection: keep-alive\r\n"
+    "If-None-Match: \"5f3a-a1-64b0c2f1\"\r\n\r\n",
+    "GET /picS.jpg HTTP/1.1\r\nHost: 127.0.0.1:8080\r\nUser-Agent: curl/8.5.0\r\nAccept: */*\r\n\r\n"
+};
+#define MB_COUNT(a) (sizeof(a) / sizeof(a[0]))
+
+
+/*
+ * Implementations of the first release, kept to show what replacing them gained.
+ * They are copied as they were, only renamed.
+ */
+enum legacy_extension { LEGACY_HTML, LEGACY_JPEG, LEGACY_UNKNOWN };
+
+const std::string legacy_get_time_in_gmt(time_t stamp) {
+    char t[50];
+    strftime(t, sizeof(t), "%a, %d %h %Y %T GMT", gmtime(&stamp));
+    return t;
+}
+
+const std::string legacy_get_time_for_logging(time_t stamp) {
+    char t[50];
+    strftime(t, sizeof(t), "%d/%b/%Y:%X %z", localtime(&stamp));
+    return t;
+}
+
+int legacy_get_method_as_int(const char * method) {
+    if (strcmp(method, HTTP_REQUEST_GET_S) == 0)
+        return HTTP_REQUEST_GET;
+    else if (strcmp(method, HTTP_REQUEST_HEAD_S) == 0)
+        return HTTP_REQUEST_HEAD;
+    else return -1;
+}
+
+std::string legacy_normalize_path(char const * page) {
+    std::string normalized(page);
+    if (normalized.front() == '~') {
+        normalized.erase(0, 1);
+        normalized.insert(0, "/myhttpd");
+        normalized.insert(0, getpwuid(getuid())->pw_dir);
+    }
+    else if (!strlen(page) || page[0] != '/')
+        return "";
+    else normalized.insert(0, ".");
+    return normalized;
+}
+
+legacy_extension legacy_get_file_extension(const char * path) {
+    if (strcasestr(path, "html") || strcasestr(path, "htm"))
+        return LEGACY_HTML;
+    if (strcasestr(path, "jpg") || strcasestr(path, "jpeg"))
+        return LEGACY_JPEG;
+    return LEGACY_UNKNOWN;
+}
+
+std::string legacy_build_response_header(const http_response & resp) {
+    std::stringstream header;
+    header << SERVER_HTTP_PROTOCOL_VERSION << " " << get_status_as_string(resp.req_status) << '\n';
+    header << "Date: " << legacy_get_time_in_gmt(time(0)) << '\n';
+    header << "Server: " << SERVER_INFO << '\n';
+    if (resp.mod_time)
+        header << "Last-Modified: " << legacy_get_time_in_gmt(resp.mod_time) << '\n';
+    if (resp.content_type)
+        header << "Content-Type: " << resp.content_type << '\n';
+    if (resp.content_length)
+        header << "Content-Length: " << resp.content_length << '\n';
+    header << '\n';
+    return header.str();
+}
+
+std::string legacy_get_logstring(const char * ip, time_t timestamp, const char * method, const char * page,
+                                 const char * http, int status, off_t length) {
+    std::stringstream out;
+    out     << ip << " ~ [" << legacy_get_time_for_logging(timestamp) << "] ["
+            << legacy_get_time_for_logging(time(0)) << "] \"" << method << " " << page
+            << " " << http << "\" " << status << " "
+            << length << std::endl;
+    return out.str();
+}
+
+
+/* Benchmarked operations */
+/* Server knows lengths of what the parser found, so the current helpers get them ready */
+static std::vector<str_ref> refs(const char * const * items, size_t count) {
+    std::vector<str_ref> out;
+    for (size_t i = 0; i < count; i++) out.push_back(str_ref(items[i], strlen(items[i])));
+    return out;
+}
+
+void bench_normalize_path(size_t n) {
+    std::vector<str_ref> pages = refs(paths, MB_COUNT(paths));
+    std::string out;
+    for (size_t i = 0; i < n; i++) {
+        normalize_path(pages[i % pages.size()], out);
+        keep(out);
+    }
+}
+
+void bench_legacy_normalize_path(size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        std::string out = legacy_normalize_path(paths[i % MB_COUNT(paths)]);
+        keep(out);
+    }
+}
+
+void bench_mime_lookup(size_t n) {
+    std::vector<str_ref> pages = refs(paths, MB_COUNT(paths));
+    for (size_t i = 0; i < n; i++) {
+        mime_type type = mime_lookup(pages[i % pages.size()].data, pages[i % pages.size()].len);
+        keep(type);
+    }
+}
+
+void bench_legacy_get_file_extension(size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        legacy_extension ext = legacy_get_file_extension(paths[i % MB_COUNT(paths)]);
+        keep(ext);
+    }
+}
+
+void bench_get_method_as_int(size_t n) {
+    std::vector<str_ref> names = refs(methods, MB_COUNT(methods));
+    for (size_t i = 0; i < n; i++) {
+        int m = get_method_as_int(names[i % names.size()]);
+        keep(m);
+    }
+}
+
+void bench_legacy_get_method_as_int(size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        int m = legacy_get_method_as_int(methods[i % MB_COUNT(methods)]);
+        keep(m);
+    }
+}
+
+void bench_format_http_date(size_t n) {
+    char date[HTTP_DATE_LENGTH];
+    time_t base = time(0);
+    for (size_t i = 0; i < n; i++) {
+        size_t len = format_http_date(base - i % 86400, date);
+        keep(len);
+        keep(date);
+    }
+}
+
+void bench_legacy_get_time_in_gmt(size_t n) {
+    time_t base = time(0);
+    for (size_t i = 0; i < n; i++) {
+        std::string date = legacy_get_time_in_gmt(base - i % 86400);
+        keep(date);
+    }
+}
+
+static http_response sample_response() {
+    http_response resp;
+    resp.req_status = HTTP_STATUS_CODE_OK;
+    resp.content_type = TYPE_MIME_TEXT_HTML;
+    resp.cache_control = mime_cache_control(MIME_CLASS_DOCUMENT);
+    resp.mod_time = time(0) - 3600;
+    resp.content_length = 161;
+    resp.keep_alive = true;
+    resp.etag_len = snprintf(resp.etag, sizeof(resp.etag), "\"5f3a-a1-64b0c2f1\"");
+    return resp;
+}
+
+void bench_build_response_header(size_t n) {
+    http_response resp = sample_response();
+    static header_builder header;
+    for (size_t i = 0; i < n; i++) {
+        build_response_header(resp, header);
+        keep(header);
+    }
+}
+
+void bench_legacy_build_response_header(size_t n) {
+    http_response resp = sample_response();
+    for (size_t i = 0; i < n; i++) {
+        std::string header = legacy_build_response_header(resp);
+        keep(header);
+    }
+}
+
+void bench_get_logstring(size_t n) {
+    const char * line = requests[1];
+    http_request req;
+    req.method = str_ref(line, 3);
+    req.page = str_ref(line + 4, 9);
+    req.http = str_ref(line + 14, 8);
+    req.timestamp = time(0);
+    strcpy(req.rem_ip, "192.168.100.200");
+    http_response resp = sample_response();
+    static log_line out;
+    for (size_t i = 0; i < n; i++) {
+        get_logstring(&req, resp, out);
+        keep(out);
+    }
+}
+
+void bench_legacy_get_logstring(size_t n) {
+    time_t timestamp = time(0);
+    for (size_t i = 0; i < n; i++) {
+        std::string out = legacy_get_logstring("192.168.100.200", timestamp, "GET", "/picS.jpg", "HTTP/1.1", 200, 161);
+        keep(out);
+    }
+}
+
+void bench_parse_request(size_t n) {
+    std::vector<str_ref> input = refs(requests, MB_COUNT(requests));
+    http_parser parser;
+    for (size_t i = 0; i < n; i++) {
+        parser.reset();
+        parse_result r = parser.parse(input[i % input.size()].data, input[i % input.size()].len);
+        keep(r);
+        keep(parser);
+    }
+}
+
+/* Only the request line was read, header fields were ignored */
+void bench_legacy_parse_request(size_t n) {
+    char method[6], page[1025], http[9];
+    for (size_t i = 0; i < n; i++) {
+        int r = sscanf(requests[i % MB_COUNT(requests)], "%5s %1024s %8s", method, page, http);
+        keep(r);
+        keep(page);
+    }
+}
+
+/* Current implementation is followed by the one it replaced, named <name>.legacy */
+static const mb_case cases[] = {
+    { "normalize_path", bench_normalize_path },
+    { "normalize_path.legacy", bench_legacy_normalize_path },
+    { "mime_lookup", bench_mime_lookup },
+    { "get_file_extension.legacy", bench_legacy_get_file_extension },
+    { "get_method_as_int", bench_get_method_as_int },
+    { "get_method_as_int.legacy", bench_legacy_get_method_as_int },
+    { "format_http_date", bench_format_http_date },
+    { "get_time_in_gmt.legacy", bench_legacy_get_time_in_gmt },
+    { "build_response_header", bench_build_response_header },
+    { "build_response_header.legacy", bench_legacy_build_response_header },
+    { "get_logstring", bench_get_logstring },
+    { "get_logstring.legacy", bench_legacy_get_logstring },
+    { "parse_request", bench_parse_request },
+    { "parse_request.legacy", bench_legacy_parse_request },
+};
+
+
+void print_bench_usage(const char * exec) {
+    std::cout   << "\nUSAGE: " << exec << " [Options]\n\n"
+                << "Runs microbenchmarks of the request path helpers and prints one JSON line\n"
+                << "per benchmark: ns, heap allocations and instructions per operation.\n"
+                << "Instructions are null where perf events aren't available.\n\n"
+                << "Options:\n" << "\t-h\t\tPrint a usage summary;\n"
+                << "\t-t <ms>\tDuration of every repetition. Default: 100;\n"
+                << "\t-r <count>\tNumber of repetitions, the best one is reported. Default: 5;\n"
+                << "\t-f <text>\tRun only benchmarks whose name contains the text;\n"
+                << "\t-l\t\tList benchmarks and exit;\n\n";
+    exit(0);
+}
+
+void parse_bench_args(int ac, char * av[]) {
+    const char * exec_name = av[0];
+    try {
+        for(int i=1; i<ac; i++) {
+            std::string current = av[i];
+            if (current.size() != 2 || current[0] != '-') print_bench_usage(exec_name);
+            switch (current[1]) {
+                case 't':
+                if (++i >= ac) print_bench_usage(exec_name);
+                mb_params.time_ms = std::stoi(av[i]);
+                break;
+                case 'r':
+                if (++i >= ac) print_bench_usage(exec_name);
+                mb_params.repetitions = std::stoi(av[i]);
+                break;
+                case 'f':
+                if (++i >= ac) print_bench_usage(exec_name);
+                mb_params.filter = av[i];
+                break;
+                case 'l':
+                for (const mb_case & c : cases) std::cout << c.name << "\n";
+                exit(0);
+                default:
+                print_bench_usage(exec_name);
+            }
+        }
+    }
+    catch (const std::exception &) {
+        print_bench_usage(exec_name);
+    }
+    if (mb_params.time_ms < 1 || mb_params.repetitions < 1) print_bench_usage(exec_name);
+}
+
+/* Counts user space instructions of the calling thread. Returns -1 if perf events can't be used */
+int open_instruction_counter() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+uint64_t read_counter(int fd) {
+    uint64_t value = 0;
+    if (read(fd, &value, sizeof(value)) != sizeof(value)) return 0;
+    return value;
+}
+
+/*
+ * Calibration run sizes the repetitions and warms caches up, so allocations
+ * made once, like thread local buffers, aren't counted. Best repetition is
+ * reported, it is the one least disturbed by the rest of the machine.
+ */
+mb_result measure(const mb_case & c, int counter) {
+    mb_clock::time_point start = mb_clock::now();
+    c.run(MB_CALIBRATION_ITERATIONS);
+    double calibration = std::chrono::duration<double, std::nano>(mb_clock::now() - start).count();
+    mb_result best;
+    best.iterations = std::max<size_t>(1, (size_t)(MB_CALIBRATION_ITERATIONS * mb_params.time_ms * 1e6 /
+                                                   std::max(calibration, 1.0)));
+    best.ns = best.allocs = best.instructions = -1;
+    for (int rep = 0; rep < mb_params.repetitions; rep++) {
+        if (counter != -1) {
+            ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        uint64_t allocs = allocation_count();
+        start = mb_clock::now();
+        c.run(best.iterations);
+        double ns = std::chrono::duration<double, std::nano>(mb_clock::now() - start).count();
+        allocs = allocation_count() - allocs;
+        if (counter != -1) ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+        if (best.ns < 0 || ns < best.ns) best.ns = ns;
+        if (best.allocs < 0 || allocs < best.allocs) best.allocs = allocs;
+        if (counter != -1) {
+            double instructions = read_counter(counter);
+            if (best.instructions < 0 || instructions < best.instructions) best.instructions = instructions;
+        }
+    }
+    best.ns /= best.iterations;
+    best.allocs /= best.iterations;
+    if (best.instructions >= 0) best.instructions /= best.iterations;
+    return best;
+}
+
+int main(int argc, char * argv[]) {
+    parse_bench_args(argc, argv);
+    /* Server state the helpers read */
+    refresh_date();
+    int counter = open_instruction_counter();
+    for (const mb_case & c : cases) {
+        if (!mb_params.filter.empty() && !strstr(c.name, mb_params.filter.c_str())) continue;
+        mb_result r = measure(c, counter);
+        char instructions[32] = "null";
+        if (r.instructions >= 0) snprintf(instructions, sizeof(instructions), "%.1f", r.instructions);
+        printf("{\"name\":\"%s\",\"iterations\":%zu,\"ns_per_op\":%.1f,\"allocs_per_op\":%.3f,\"instructions_per_op\":%s}\n",
+               c.name, r.iterations, r.ns, r.allocs, instructions);
+        fflush(stdout);
+    }
+    if (counter != -1) close(counter);
+    return 0;
+}
@@ -0,0 +1,57 @@
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "myhttpd.h"
+#include "mime.h"
+
+/* Defaults of the microbenchmarks */
+#define MB_DEFAULT_TIME                     100     // ms every repetition runs for
+#define MB_DEFAULT_REPETITIONS              5       // best one is reported
+/* Iterations of the calibration run, measured time scales them to MB_DEFAULT_TIME */
+#define MB_CALIBRATION_ITERATIONS           1000
+
+typedef std::chrono::steady_clock mb_clock;
+
+/* Structure holds parameters of a run */
+static struct mb_parameters {
+    int time_ms = MB_DEFAULT_TIME;
+    int repetitions = MB_DEFAULT_REPETITIONS;
+    std::string filter;                 // only benchmarks whose name contains it
+} mb_params;
+
+/* Benchmark runs its operation given number of times on representative inputs */
+struct mb_case {
+    const char * name;
+    void (*run)(size_t);
+};
+
+struct mb_result {
+    double ns, allocs, instructions;    // per operation, instructions < 0 if not counted
+    size_t iterations;
+};
+
+/* Keeps compiler from dropping a computation whose result is unused */
+template <typename T>
+inline void keep(const T & value) { asm volatile("" : : "r"(&value) : "memory"); }
+
+void print_bench_usage(const char *);
+void parse_bench_args(int, char *[]);
+int open_instruction_counter();
+uint64_t read_counter(int);
+mb_result measure(const mb_case &, int);
+
+#endif
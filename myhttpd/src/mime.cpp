@@ -0,0 +1,183 @@
+#include "mime.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+/*
+ * Built-in table is hashed at compile time. Every extension gets a slot of its
+ * own in a table of 2^MIME_HASH_BITS, so a lookup is one hash of the extension,
+ * one slot and one string compare. Seed was picked so the extensions below
+ * don't collide, the static_assert fails if an edit breaks that.
+ */
+#define MIME_HASH_BITS                      8
+#define MIME_HASH_SEED                      0x811c9dd4u     // FNV-1a offset basis + 15
+#define MIME_HASH_PRIME                     16777619u
+
+namespace {
+
+struct mime_entry {
+    const char * ext;
+    const char * type;
+    mime_class cls;
+};
+
+constexpr mime_entry builtin[] = {
+    {"html",        "text/html",                    MIME_CLASS_DOCUMENT},
+    {"htm",         "text/html",                    MIME_CLASS_DOCUMENT},
+    {"xhtml",       "application/xhtml+xml",        MIME_CLASS_DOCUMENT},
+    {"txt",         "text/plain",                   MIME_CLASS_DOCUMENT},
+    {"json",        "application/json",             MIME_CLASS_DOCUMENT},
+    {"xml",         "application/xml",              MIME_CLASS_DOCUMENT},
+    {"csv",         "text/csv",                     MIME_CLASS_DOCUMENT},
+    {"md",          "text/markdown",                MIME_CLASS_DOCUMENT},
+    {"css",         "text/css",                     MIME_CLASS_ASSET},
+    {"js",          "text/javascript",              MIME_CLASS_ASSET},
+    {"mjs",         "text/javascript",              MIME_CLASS_ASSET},
+    {"map",         "application/json",             MIME_CLASS_ASSET},
+    {"wasm",        "application/wasm",             MIME_CLASS_ASSET},
+    {"webmanifest", "application/manifest+json",    MIME_CLASS_ASSET},
+    {"jpg",         "image/jpeg",                   MIME_CLASS_MEDIA},
+    {"jpeg",        "image/jpeg",                   MIME_CLASS_MEDIA},
+    {"png",         "image/png",                    MIME_CLASS_MEDIA},
+    {"gif",         "image/gif",                    MIME_CLASS_MEDIA},
+    {"webp",        "image/webp",                   MIME_CLASS_MEDIA},
+    {"avif",        "image/avif",                   MIME_CLASS_MEDIA},
+    {"svg",         "image/svg+xml",                MIME_CLASS_MEDIA},
+    {"ico",         "image/vnd.microsoft.icon",     MIME_CLASS_MEDIA},
+    {"bmp",         "image/bmp",                    MIME_CLASS_MEDIA},
+    {"woff",        "font/woff",                    MIME_CLASS_MEDIA},
+    {"woff2",       "font/woff2",                   MIME_CLASS_MEDIA},
+    {"ttf",         "font/ttf",                     MIME_CLASS_MEDIA},
+    {"otf",         "font/otf",                     MIME_CLASS_MEDIA},
+    {"eot",         "application/vnd.ms-fontobject", MIME_CLASS_MEDIA},
+    {"mp3",         "audio/mpeg",                   MIME_CLASS_MEDIA},
+    {"ogg",         "audio/ogg",                    MIME_CLASS_MEDIA},
+    {"wav",         "audio/wav",                    MIME_CLASS_MEDIA},
+    {"mp4",         "video/mp4",                    MIME_CLASS_MEDIA},
+    {"webm",        "video/webm",                   MIME_CLASS_MEDIA},
+    {"pdf",         "application/pdf",              MIME_CLASS_MEDIA},
+    {"zip",         "application/zip",              MIME_CLASS_MEDIA},
+    {"gz",          "application/gzip",             MIME_CLASS_MEDIA},
+    {"tar",         "application/x-tar",            MIME_CLASS_MEDIA},
+};
+
+constexpr size_t builtin_count = sizeof(builtin) / sizeof(builtin[0]);
+constexpr size_t slot_count = 1 << MIME_HASH_BITS;
+static_assert(builtin_count < slot_count, "MIME table is larger than its hash table");
+
+constexpr char lower(char c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; }
+
+constexpr size_t length(const char * s) { return *s ? 1 + length(s + 1) : 0; }
+
+/* FNV-1a of the lowercased extension, slot is taken from the best mixed top bits */
+constexpr uint32_t hash(const char * s, size_t len, uint32_t h) {
+    return len ? hash(s + 1, len - 1, (h ^ (uint8_t)lower(*s)) * MIME_HASH_PRIME) : h;
+}
+
+constexpr size_t slot(const char * s, size_t len) {
+    return hash(s, len, MIME_HASH_SEED) >> (32 - MIME_HASH_BITS);
+}
+
+constexpr size_t entry_slot(size_t i) { return slot(builtin[i].ext, length(builtin[i].ext)); }
+
+constexpr bool distinct_from(size_t i, size_t j) {
+    return j == builtin_count || (entry_slot(i) != entry_slot(j) && distinct_from(i, j + 1));
+}
+
+constexpr bool perfect(size_t i) {
+    return i == builtin_count || (distinct_from(i, i + 1) && perfect(i + 1));
+}
+
+static_assert(perfect(0), "MIME extensions collide, pick another MIME_HASH_SEED");
+
+/* Index of the entry hashed into slot s, builtin_count for an empty slot */
+constexpr uint8_t find_entry(size_t s, size_t i) {
+    return i == builtin_count ? builtin_count : entry_slot(i) == s ? i : find_entry(s, i + 1);
+}
+
+template <size_t... I> struct indices {};
+template <size_t N, size_t... I> struct make_indices : make_indices<N - 1, N - 1, I...> {};
+template <size_t... I> struct make_indices<0, I...> { typedef indices<I...> type; };
+
+struct slot_table {
+    uint8_t entry[slot_count];
+};
+
+template <size_t... I>
+constexpr slot_table build_slots(indices<I...>) { return slot_table{{find_entry(I, 0)...}}; }
+
+constexpr slot_table slots = build_slots(make_indices<slot_count>::type());
+
+/* Entries of a MIME types file, read once at startup and never changed afterwards */
+struct mime_override {
+    std::string type;
+    mime_class cls;
+};
+std::unordered_map<std::string, mime_override> overrides;
+
+const mime_entry * find_builtin(const char * ext, size_t len) {
+    uint8_t i = slots.entry[slot(ext, len)];
+    if (i == builtin_count || strncasecmp(builtin[i].ext, ext, len) || builtin[i].ext[len]) return NULL;
+    return &builtin[i];
+}
+
+}
+
+/* Returns type of a file by the suffix after the last dot of its name, case doesn't matter */
+mime_type mime_lookup(const char * path, size_t len) {
+    const mime_type unknown = {MIME_DEFAULT_TYPE, MIME_CLASS_NONE};
+    const char * end = path + len, * p = end;
+    while (p > path && p[-1] != '.' && p[-1] != '/') p--;
+    /* No dot in the name, or name starting with its only dot like .htaccess */
+    if (p == path || p[-1] != '.' || p - 1 == path || p[-2] == '/') return unknown;
+    size_t ext_len = end - p;
+    if (!ext_len || ext_len > MIME_MAX_EXTENSION) return unknown;
+    if (!overrides.empty()) {
+        char key[MIME_MAX_EXTENSION];
+        for (size_t i=0; i<ext_len; i++) key[i] = lower(p[i]);
+        auto it = overrides.find(std::string(key, ext_len));
+        if (it != overrides.end()) return mime_type{it->second.type.c_str(), it->second.cls};
+    }
+    const mime_entry * e = find_builtin(p, ext_len);
+    return e ? mime_type{e->type, e->cls} : unknown;
+}
+
+/*
+ * Reads a file in mime.types format, "type ext ext ..." per line with # comments,
+ * so /etc/mime.types works as is. Its entries take precedence over the built-in
+ * ones and keep their cache class, extensions the server doesn't know get none
+ */
+bool mime_load(const std::string & path) {
+    std::ifstream in(path);
+    if (!in) return false;
+    std::string line;
+    while (std::getline(in, line)) {
+        line.erase(std::min(line.find('#'), line.length()));
+        std::istringstream fields(line);
+        std::string type, ext;
+        if (!(fields >> type)) continue;
+        while (fields >> ext) {
+            if (ext.length() > MIME_MAX_EXTENSION) continue;
+            for (char & c : ext) c = lower(c);
+            const mime_entry * e = find_builtin(ext.data(), ext.length());
+            overrides[ext] = mime_override{type, e ? e->cls : MIME_CLASS_NONE};
+        }
+    }
+    return true;
+}
+
+const char * mime_cache_control(mime_class cls) {
+    switch (cls) {
+        case MIME_CLASS_DOCUMENT:
+            return "no-cache";
+        case MIME_CLASS_ASSET:
+            return "max-age=3600";
+        case MIME_CLASS_MEDIA:
+            return "max-age=86400";
+        default:
+            return NULL;
+    }
+}
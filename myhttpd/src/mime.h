@@ -0,0 +1,29 @@
+#ifndef MIME_H
+#define MIME_H
+
+#include <cstddef>
+#include <string>
+
+/* Type of a file whose extension isn't known */
+#define MIME_DEFAULT_TYPE                   "application/octet-stream"
+/* Longer extensions are never looked up, shorter ones fit std::string without allocation */
+#define MIME_MAX_EXTENSION                  15
+
+/* How long clients may keep a response without asking again */
+enum mime_class {
+    MIME_CLASS_NONE,        // no Cache-Control is sent
+    MIME_CLASS_DOCUMENT,    // revalidated on every use, it may change any time
+    MIME_CLASS_ASSET,       // stylesheets and scripts, kept for an hour
+    MIME_CLASS_MEDIA        // images, fonts, audio, video and archives, kept for a day
+};
+
+struct mime_type {
+    const char * type;
+    mime_class cls;
+};
+
+mime_type mime_lookup(const char *, size_t);
+bool mime_load(const std::string &);
+const char * mime_cache_control(mime_class);
+
+#endif
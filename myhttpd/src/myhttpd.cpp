@@ -2,18 +2,20 @@
 #include "myhttpd.h"
 
 
-int socket_fd, con_fd, y = 1;
+int signal_fd, y = 1;
 struct addrinfo socket_init_info, *socket_info;
-struct sockaddr_in con_info;
-socklen_t con_socklen = sizeof(con_info);
+std::vector<shard *> shards;
 Log logging;
-std::priority_queue<http_request *, std::vector<http_request *>,
-                    std::function<bool(http_request *, http_request *)>> * request_queue;
-std::mutex mutex_rq;
-std::condition_variable cv_rq;
-std::vector<std::mutex *> mutex_wt;
-std::vector<std::condition_variable *> cv_wt;
-std::vector<http_request *> jobs;
+content_cache content;
+docroot_index docroot;
+rate_limiter limiter;
+std::string home_root;
+/* Set by SIGTERM or SIGINT, reactors leave their loops and wait for their workers */
+std::atomic<bool> stopping(false);
+std::mutex stop_mutex;
+std::condition_variable stop_cv;
+char date_cache[2][HTTP_DATE_LENGTH];
+std::atomic<int> date_slot(0);
 
 
 /* Turns caller process into daemon */
@@ -35,8 +37,37 @@ void print_usage(const char * exec) {
                 << "\t-p <port>\tListen on the given port;\n"
                 << "\t-r <dir>\tSet root directory for the server;\n"
                 << "\t-t <time>\tSet queuing time in seconds;\n"
-                << "\t-n <threads>\tSet number of threads. Default: 4;\n"
-                << "\t-s <policy>\tSet scheduling policy: FCFS or SJF. Default: FCFS;\n\n";
+                << "\t-n <min>[:<max>]\tSet number of threads per shard. With a range the pool grows\n"
+                << "\t\t\twhile requests wait with every worker busy and shrinks when workers idle. Default: 4;\n"
+                << "\t-G <ms>\tAdd a worker once the next request waited this long with all busy. Default: 10;\n"
+                << "\t-I <time>\tRetire a worker above the minimum after idling this many seconds. Default: 30;\n"
+                << "\t-j <shards>\tRun shards with own listener (SO_REUSEPORT), reactor and workers,\n"
+                << "\t\t\teach pinned to a CPU. Default: 1;\n"
+                << "\t-s <policy>\tSet scheduling policy: FCFS, SJF, SRPT (smallest first with aging),\n"
+                << "\t\t\tEDF (earliest deadline first) or SPLIT (small and large requests,\n"
+                << "\t\t\tlarge ones never take every worker) or FAIR (clients take turns). Default: FCFS;\n"
+                << "\t-o <name=value>\tTune scheduling policy: srpt.aging (bytes per ms of waiting),\n"
+                << "\t\t\tedf.slack (ms), edf.rate (bytes per ms), split.threshold (bytes),\n"
+                << "\t\t\tsplit.reserve (workers kept for small requests);\n"
+                << "\t-w <net/bits=weight>\tGive clients of a subnet more turns under FAIR, may be repeated.\n"
+                << "\t\t\tOther clients have weight 1;\n"
+                << "\t-k <time>\tSet keep-alive idle timeout in seconds, 0 disables keep-alive. Default: 5;\n"
+                << "\t-K <count>\tSet maximum number of requests per connection. Default: 100;\n"
+                << "\t-b\t\tSend files through a fixed buffer instead of sendfile();\n"
+                << "\t-c <size>\tSet content cache size, K/M/G suffix allowed, 0 disables it. Default: 64M;\n"
+                << "\t\t\tSIGUSR1 writes cache statistics to the log;\n"
+                << "\t-f <ms>\tSet log flush interval in milliseconds. Default: 200;\n"
+                << "\t-L <policy>\tSet what happens when log buffer is full: block or drop. Default: block;\n"
+                << "\t-m <file>\tRead MIME types from a file in mime.types format, its entries\n"
+                << "\t\t\toverride the built-in ones;\n"
+                << "\t-i\t\tResolve paths with stat() instead of the in-memory document root index;\n"
+                << "\t-Q <count>\tSet how many requests may wait in a shard's queue, more are answered\n"
+                << "\t\t\twith 503, 0 is unbounded. Default: 1024;\n"
+                << "\t-D <ms>\tAnswer requests that waited longer with 503 instead of serving them,\n"
+                << "\t\t\t0 disables it. Default: 0;\n"
+                << "\t-R <rate>[:<burst>]\tLimit requests per second of every client IP, more are\n"
+                << "\t\t\tanswered with 429. Limit holds across all shards. Burst defaults\n"
+                << "\t\t\tto rate, 0 disables it. Default: 0;\n\n";
     exit(0);
 }
 
@@ -50,10 +81,56 @@ void parse_args(int ac, char * av[]) {
                 switch (current[1]) {
                     case 'd':
                     serv_params.debugging = true;
-                    serv_params.threads = 1;
+                    serv_params.threads = serv_params.min_threads = 1;
                     break;
                     case 'h':
                     print_usage(exec_name);
+                    case 'b':
+                    serv_params.zero_copy = false;
+                    break;
+                    case 'm':
+                    if (++i >= ac) print_usage(exec_name);
+                    serv_params.mime_file = av[i];
+                    break;
+                    case 'i':
+                    serv_params.doc_index = false;
+                    break;
+                    case 'Q':
+                    if (++i >= ac) print_usage(exec_name);
+                    serv_params.queue_max = std::stoul(av[i]);
+                    break;
+                    case 'D':
+                    if (++i >= ac) print_usage(exec_name);
+                    serv_params.deadline_ms = std::stoi(av[i]);
+                    break;
+                    case 'R':
+                    {
+                        if (++i >= ac) print_usage(exec_name);
+                        std::string limit = av[i];
+                        size_t colon = limit.find(':');
+                        serv_params.rate_limit = std::stod(limit.substr(0, colon));
+                        serv_params.rate_burst = colon == std::string::npos
+                                                 ? serv_params.rate_limit : std::stod(limit.substr(colon + 1));
+                        if (serv_params.rate_limit < 0 || serv_params.rate_burst < 1) print_usage(exec_name);
+                        break;
+                    }
+                    case 'c':
+                    if (++i >= ac) print_usage(exec_name);
+                    serv_params.cache_size = parse_size(av[i]);
+                    break;
+                    case 'f':
+                    if (++i >= ac) print_usage(exec_name);
+                    serv_params.log_flush_ms = std::stoi(av[i]);
+                    break;
+                    case 'L':
+                    {
+                        if (++i >= ac) print_usage(exec_name);
+                        std::string policy = av[i];
+                        if (policy == "drop") serv_params.log_drop = true;
+                        else if (policy == "block") serv_params.log_drop = false;
+                        else print_usage(exec_name);
+                        break;
+                    }
                     case 'l':
                     if (++i >= ac) print_usage(exec_name);
                     serv_params.logfile = av[i];
@@ -71,21 +148,57 @@ void parse_args(int ac, char * av[]) {
                     serv_params.q_time = std::stoi(av[i]);
                     break;
                     case 'n':
+                    {
+                        if (++i >= ac) print_usage(exec_name);
+                        std::string range = av[i];
+                        size_t colon = range.find(':');
+                        serv_params.min_threads = std::stoi(range.substr(0, colon));
+                        serv_params.threads = colon == std::string::npos
+                                              ? serv_params.min_threads : std::stoi(range.substr(colon + 1));
+                        if (serv_params.min_threads < 1 || serv_params.threads < serv_params.min_threads)
+                            print_usage(exec_name);
+                        if (serv_params.debugging) serv_params.threads = serv_params.min_threads = 1;
+                        break;
+                    }
+                    case 'G':
                     if (++i >= ac) print_usage(exec_name);
-                    serv_params.threads = (serv_params.debugging) ? 1 : std::stoi(av[i]);
+                    serv_params.pool_grow_ms = std::stoi(av[i]);
+                    if (serv_params.pool_grow_ms < 0) print_usage(exec_name);
+                    break;
+                    case 'I':
+                    if (++i >= ac) print_usage(exec_name);
+                    serv_params.pool_idle_s = std::stoi(av[i]);
+                    if (serv_params.pool_idle_s < 1) print_usage(exec_name);
+                    break;
+                    case 'j':
+                    if (++i >= ac) print_usage(exec_name);
+                    serv_params.shards = std::stoi(av[i]);
+                    if (serv_params.shards < 1) print_usage(exec_name);
+                    break;
+                    case 'k':
+                    if (++i >= ac) print_usage(exec_name);
+                    serv_params.keepalive_timeout = std::stoi(av[i]);
+                    break;
+                    case 'K':
+                    if (++i >= ac) print_usage(exec_name);
+                    serv_params.keepalive_max = std::stoi(av[i]);
                     break;
                     case 's':
                     {
                         if (++i >= ac) print_usage(exec_name);
                         std::string policy = av[i];
-                        if (policy == "SJF") {
-                            request_queue = new std::priority_queue<http_request *, std::vector<http_request *>,
-                                                std::function<bool(http_request *, http_request *)>>(compare_size);
-                        }
-                        else if (policy == "FCFS") {}
-                        else print_usage(exec_name);
+                        scheduler * known = make_scheduler(policy, serv_params.sched, 1);
+                        if (!known) print_usage(exec_name);
+                        delete known;
+                        serv_params.policy = policy;
                         break;
                     }
+                    case 'o':
+                    if (++i >= ac || !sched_set_option(serv_params.sched, av[i])) print_usage(exec_name);
+                    break;
+                    case 'w':
+                    if (++i >= ac || !sched_add_weight(serv_params.sched, av[i])) print_usage(exec_name);
+                    break;
                 }
             }
             else print_usage(exec_name);
@@ -96,43 +209,86 @@ void parse_args(int ac, char * av[]) {
     }
 }
 
+/* Helper method parses byte count with optional K, M or G suffix */
+size_t parse_size(const std::string & arg) {
+    size_t pos;
+    unsigned long long n = std::stoull(arg, &pos);
+    switch (toupper(arg[pos])) {
+        case 'G': n <<= 10;     // fall through
+        case 'M': n <<= 10;     // fall through
+        case 'K': n <<= 10;     // fall through
+        case '\0': break;
+        default: throw std::invalid_argument(arg);
+    }
+    return n;
+}
+
 /* Helper method to print errno to stderr */
 void pr_error(const char * msg) {
     perror(msg);
     exit(1);
 }
 
-/* Helper method to compare timestamps of two requests */
-bool compare_time(http_request * r1, http_request * r2) {
-    return r1->timestamp >= r2->timestamp;
-}
-
-/* Helper method to compare filesizes of two requests */
-bool compare_size(http_request * r1, http_request * r2) {
-    return r1->f_size <= r2->f_size;
-}
+int create_socket_open_port() {
+    int socket_fd;
+    /* Address is resolved once, every shard binds the same one */
+    if (!socket_info) {
+        /* Filling up socket_init_info with initial information */
+        memset(&socket_init_info, 0, sizeof(socket_init_info));                 // Emptying the structure
+        socket_init_info.ai_family = AF_INET;                                   // Use IPv4 address
+        socket_init_info.ai_flags = AI_PASSIVE;                                 // Get the address of localhost
+        socket_init_info.ai_socktype = SOCK_STREAM;                             // Socket type set to TCP
 
-void create_socket_open_port() {
-    /* Filling up socket_init_info with initial information */
-    memset(&socket_init_info, 0, sizeof(socket_init_info));                 // Emptying the structure
-    socket_init_info.ai_family = AF_INET;                                   // Use IPv4 address
-    socket_init_info.ai_flags = AI_PASSIVE;                                 // Get the address of localhost
-    socket_init_info.ai_socktype = SOCK_STREAM;                             // Socket type set to TCP
-
-    /* Filling up socket_info structure */
-    getaddrinfo(NULL, serv_params.port.c_str(), &socket_init_info, &socket_info);
+        /* Filling up socket_info structure */
+        getaddrinfo(NULL, serv_params.port.c_str(), &socket_init_info, &socket_info);
+    }
     /* Creating a socket */
     if ((socket_fd = socket(socket_info->ai_family, socket_info->ai_socktype, socket_info->ai_protocol)) == -1)
         pr_error("error while creating socket");
     /* Set REUSEPORT option so the program can reuse the port after restart */
     if (setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &y, socket_info->ai_addrlen) == -1)
         pr_error("failed setting socket option");
+    /* Shards bind the same port, kernel balances incoming connections between their listeners */
+    if (serv_params.shards > 1 && setsockopt(socket_fd, SOL_SOCKET, SO_REUSEPORT, &y, sizeof(y)) == -1)
+        pr_error("failed setting socket option");
     /* Binding socket to the port */
     if ((bind(socket_fd, socket_info->ai_addr, socket_info->ai_addrlen)) == -1)
         pr_error("cannot associate socket with given port");
     /* Openning the port on localhost. SOMAXCONN defines queue length of completely established sockets */
     if ((listen(socket_fd, SOMAXCONN)) == -1)
         pr_error("cannot open the port");
+    set_nonblocking(socket_fd);
+    return socket_fd;
+}
+
+/* Helper method switches descriptor into non-blocking mode */
+void set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+        pr_error("cannot make descriptor non-blocking");
+}
+
+/*
+ * Helper method sends whole buffer through a non-blocking socket.
+ * Waits for the socket to become writable when kernel buffer is full.
+ * Returns false if the peer went away.
+ */
+bool send_all(int fd, const char * buf, size_t len, int flags) {
+    while (len) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL | flags);
+        if (n > 0) {
+            STATS(stats_sent(n));
+            buf += n;
+            len -= n;
+        }
+        else if (n == -1 && errno == EINTR) continue;
+        else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            if (poll(&pfd, 1, -1) == -1 && errno != EINTR) return false;
+        }
+        else return false;
+    }
+    return true;
 }
 
 /* Helper method prints debugging message and queuing counter to standart output */
@@ -142,27 +298,29 @@ void print_debugging_message() {
     int i = 0;
     while (i < serv_params.q_time) {
         std::cout << "* Queuing time: " << i << " s" << '\r' << std::flush;
-        sleep(1);
+        if (wait_for_stop(1)) break;
         i++;
     }
     std::cout << "* Queuing time: " << i << " s" << "\n\n";
 }
 
 /*
- * Helper method to convert UNIX timestamp to required time format for logging.
- * With no argument given returns current date and time.
+ * Helper method writes UNIX timestamp in required time format for logging into buf.
+ * Formatting is done once per second per thread. Two slots picked by parity of the
+ * timestamp hold both arrival and completion time when they fall into adjacent seconds.
  */
-const std::string get_time_for_logging(time_t stamp=time(0)) {
-    char t[50];
-    strftime(t, sizeof(t), "%d/%b/%Y:%X %z", localtime(&stamp));
-    return t;
-}
-
- /* Helper method to convert UNIX timestamp to GMT time representation */
-const std::string get_time_in_gmt(time_t stamp=time(0)) {
-    char t[50];
-    strftime(t, sizeof(t), "%a, %d %h %Y %T GMT", gmtime(&stamp));
-    return t;
+size_t format_log_time(time_t stamp, char * buf) {
+    static thread_local time_t cached_stamp[2] = {-1, -1};
+    static thread_local char cached[2][LOG_TIME_LENGTH];
+    static thread_local size_t cached_len[2];
+    int slot = stamp & 1;
+    if (cached_stamp[slot] != stamp) {
+        struct tm t;
+        cached_len[slot] = strftime(cached[slot], LOG_TIME_LENGTH, "%d/%b/%Y:%X %z", localtime_r(&stamp, &t));
+        cached_stamp[slot] = stamp;
+    }
+    memcpy(buf, cached[slot], cached_len[slot]);
+    return cached_len[slot];
 }
 
 /* Helper method to extract IP address as a string from sockaddr_in structure */
@@ -173,10 +331,11 @@ const std::string get_ip(struct sockaddr_in * ci) {
 }
 
 /* Helper method returns request type as integer */
-int get_method_as_int(const char * method) {
-    if (strcmp(method, HTTP_REQUEST_GET_S) == 0)
+int get_method_as_int(const str_ref & method) {
+    /* Known methods differ in length, so a single compare of constant size decides */
+    if (method.len == sizeof(HTTP_REQUEST_GET_S) - 1 && !memcmp(method.data, HTTP_REQUEST_GET_S, method.len))
         return HTTP_REQUEST_GET;
-    else if (strcmp(method, HTTP_REQUEST_HEAD_S) == 0)
+    else if (method.len == sizeof(HTTP_REQUEST_HEAD_S) - 1 && !memcmp(method.data, HTTP_REQUEST_HEAD_S, method.len))
         return HTTP_REQUEST_HEAD;
     else return -1;
 }
@@ -186,27 +345,80 @@ const char * get_status_as_string(int code) {
     switch (code) {
         case HTTP_STATUS_CODE_OK:
             return HTTP_STATUS_CODE_OK_S;
+        case HTTP_STATUS_CODE_PARTIAL:
+            return HTTP_STATUS_CODE_PARTIAL_S;
+        case HTTP_STATUS_CODE_NOT_MODIFIED:
+            return HTTP_STATUS_CODE_NOT_MODIFIED_S;
+        case HTTP_STATUS_CODE_FORBIDDEN:
+            return HTTP_STATUS_CODE_FORBIDDEN_S;
         case HTTP_STATUS_CODE_NOTFOUND:
             return HTTP_STATUS_CODE_NOTFOUND_S;
+        case HTTP_STATUS_CODE_RANGE:
+            return HTTP_STATUS_CODE_RANGE_S;
+        case HTTP_STATUS_CODE_TOO_MANY:
+            return HTTP_STATUS_CODE_TOO_MANY_S;
+        case HTTP_STATUS_CODE_UNAVAILABLE:
+            return HTTP_STATUS_CODE_UNAVAILABLE_S;
     }
     return HTTP_STATUS_CODE_BAD_REQUEST_S;
 }
 
+/* Status for a file or directory that was found but couldn't be opened, errno tells why */
+int open_error_status(int err) {
+    return err == EACCES || err == EPERM ? HTTP_STATUS_CODE_FORBIDDEN : HTTP_STATUS_CODE_NOTFOUND;
+}
+
 /*
  * Helper method substitutes ~ with current user's home directory path + /myhttpd
  * If requested path doesn't start with ~ then appends server's root directory to it
+ * Query string is not part of the path. Result is canonical: empty and "." segments
+ * are dropped and ".." removes the previous one. Climbing above the root and hidden
+ * names starting with a dot are rejected with an empty string. Path is built without
+ * touching the file system, into the caller's string so a recycled request reuses its buffer
  */
-std::string normalize_path(char const * page) {
-    std::string normalized(page);
-    if (normalized.front() == '~') {
-        normalized.erase(0, 1);
-        normalized.insert(0, "/myhttpd");
-        normalized.insert(0, getpwuid(getuid())->pw_dir);
+void normalize_path(const str_ref & page, std::string & normalized) {
+    str_ref path = request_path(page);
+    normalized.clear();
+    if (!path.len) return;
+    if (path.data[0] == '~') {
+        if (home_root.empty()) return;
+        normalized.assign(home_root);
+    }
+    else if (path.data[0] != '/')
+        return;
+    else normalized.assign(".");
+    size_t root_len = normalized.length();
+    const char * p = path.data + 1, * end = path.data + path.len;
+    while (p < end) {
+        const char * slash = find_byte(p, end, '/');
+        const char * seg_end = slash ? slash : end;
+        size_t len = seg_end - p;
+        if (len == 2 && p[0] == '.' && p[1] == '.') {
+            if (normalized.length() == root_len) {
+                normalized.clear();
+                return;
+            }
+            normalized.erase(normalized.rfind('/'));
+        }
+        else if (len > 1 && p[0] == '.') {
+            /* Hidden files and directories aren't served, listings leave them out too */
+            normalized.clear();
+            return;
+        }
+        else if (len && !(len == 1 && p[0] == '.')) {
+            normalized.push_back('/');
+            normalized.append(p, len);
+        }
+        p = seg_end + 1;
     }
-    else if (!strlen(page) || page[0] != '/')
-        return "";
-    else normalized.insert(0, ".");
-    return normalized;
+    /* Trailing slash is kept, root itself always has one */
+    if (normalized.length() == root_len || path.data[path.len - 1] == '/') normalized.push_back('/');
+}
+
+/* Helper method returns path part of request target, without query string */
+str_ref request_path(const str_ref & page) {
+    const char * query = find_byte(page.data, page.data + page.len, '?');
+    return str_ref(page.data, query ? query - page.data : page.len);
 }
 
 /* Helper method returns size of SERVER_INDEX_FILE or requested directory */
@@ -214,15 +426,16 @@ off_t get_filesize(std::string * norm_path) {
     struct stat f_info;
     f_info.st_size = 0;
     /* Try to get stat for requested file */
-    if (!stat(norm_path->c_str(), &f_info)) {
+    if (!docroot.stat_path(*norm_path, &f_info)) {
         off_t dir_size = f_info.st_size;
         /* Check whether file is directory */
         if (S_ISDIR(f_info.st_mode)) {
             if (norm_path->back() != '/') norm_path->append("/");
-            if (!stat((*norm_path + SERVER_INDEX_FILE).c_str(), &f_info)) {
-                norm_path->append(SERVER_INDEX_FILE);
-                return f_info.st_size;
-            }
+            /* Index file is tried in place, request's path keeps its capacity so nothing is allocated */
+            size_t dir_len = norm_path->length();
+            norm_path->append(SERVER_INDEX_FILE);
+            if (!docroot.stat_path(*norm_path, &f_info)) return f_info.st_size;
+            norm_path->resize(dir_len);
             return dir_size;
         }
         else return f_info.st_size;
@@ -230,247 +443,1660 @@ off_t get_filesize(std::string * norm_path) {
     return 0;
 }
 
-/* Helper method returns extension of a file provided through path argument */
-extension get_file_extension(const char * path) {
-    if (strcasestr(path, "html") || strcasestr(path, "htm"))
-        return HTML;
-    if (strcasestr(path, "jpg") || strcasestr(path, "jpeg"))
-        return JPEG;
-    return UNKNOWN;
+/* Assembles response header in worker's buffer. No allocations, no time formatting */
+void build_response_header(http_response & resp, header_builder & header) {
+    header.clear();
+    header.append(SERVER_HTTP_PROTOCOL_VERSION " ");
+    header.append(get_status_as_string(resp.req_status));
+    header.append("\r\nDate: ");
+    header.append(current_date());
+    header.append("\r\nServer: " SERVER_INFO "\r\n");
+    if (resp.keep_alive) {
+        header.append("Connection: keep-alive\r\nKeep-Alive: timeout=");
+        header.append_number(serv_params.keepalive_timeout);
+        header.append("\r\n");
+    }
+    else header.append("Connection: close\r\n");
+    if (resp.retry_after) {
+        header.append("Retry-After: ");
+        header.append_number(resp.retry_after);
+        header.append("\r\n");
+    }
+    /* Cached files carry entity header built when they were loaded, it describes the whole file */
+    if (resp.cached && resp.req_status == HTTP_STATUS_CODE_OK) header.append(resp.cached->header);
+    else if (resp.req_status == HTTP_STATUS_CODE_NOT_MODIFIED) {
+        /* 304 repeats validators and caching policy only, there is no body to describe */
+        char date[HTTP_DATE_LENGTH];
+        header.append("Last-Modified: ");
+        header.append(date, format_http_date(resp.mod_time, date));
+        header.append("\r\nETag: ");
+        header.append(resp.etag, resp.etag_len);
+        header.append("\r\n");
+        if (resp.cache_control) {
+            header.append("Cache-Control: ");
+            header.append(resp.cache_control);
+            header.append("\r\n");
+        }
+    }
+    else if (resp.stream_dir) {
+        /* Streamed listing has no length known in advance */
+        header.append("Content-Type: " TYPE_MIME_TEXT_HTML "\r\n");
+        if (resp.chunked) header.append("Transfer-Encoding: chunked\r\n");
+    }
+    else {
+        append_entity_header(header, resp.mod_time, str_ref(resp.etag, resp.etag_len), resp.content_type,
+                             resp.cache_control, resp.content_length,
+                             resp.req_status == HTTP_STATUS_CODE_OK || resp.req_status == HTTP_STATUS_CODE_PARTIAL);
+        if (resp.req_status == HTTP_STATUS_CODE_PARTIAL) {
+            header.append("Content-Range: bytes ");
+            header.append_number(resp.range_start);
+            header.append("-");
+            header.append_number(resp.range_start + resp.content_length - 1);
+            header.append("/");
+            header.append_number(resp.file_size);
+            header.append("\r\n");
+        }
+        else if (resp.req_status == HTTP_STATUS_CODE_RANGE) {
+            header.append("Content-Range: bytes */");
+            header.append_number(resp.file_size);
+            header.append("\r\n");
+        }
+    }
+    header.append("\r\n");
+}
+
+/* Helper method appends header fields describing the body of a response */
+void append_entity_header(header_builder & header, time_t mod_time, const str_ref & etag,
+                          const char * content_type, const char * cache_control, off_t content_length,
+                          bool accept_ranges) {
+    if (mod_time) {
+        char date[HTTP_DATE_LENGTH];
+        header.append("Last-Modified: ");
+        header.append(date, format_http_date(mod_time, date));
+        header.append("\r\n");
+    }
+    if (!etag.empty()) {
+        header.append("ETag: ");
+        header.append(etag.data, etag.len);
+        header.append("\r\n");
+    }
+    if (content_type) {
+        header.append("Content-Type: ");
+        header.append(content_type);
+        header.append("\r\n");
+    }
+    if (cache_control) {
+        header.append("Cache-Control: ");
+        header.append(cache_control);
+        header.append("\r\n");
+    }
+    /* Length is always given so the client can find the end of the body on a persistent connection */
+    header.append("Content-Length: ");
+    header.append_number(content_length);
+    header.append("\r\n");
+    if (accept_ranges) header.append("Accept-Ranges: bytes\r\n");
+}
+
+/* Helper method reads decimal offset, value is -1 when there are no digits and saturates on overflow */
+static const char * scan_offset(const char * p, const char * end, off_t & value) {
+    const off_t max = std::numeric_limits<off_t>::max();
+    value = -1;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        int digit = *p - '0';
+        if (value == -1) value = 0;
+        value = value > (max - digit) / 10 ? max : value * 10 + digit;
+    }
+    return p;
+}
+
+/*
+ * Interprets Range header value against a file of given size (RFC 7233, 2.1).
+ * Only a single "first-last", "first-" or "-suffix" range is served, a list of
+ * ranges would need a multipart body so the whole file is sent instead.
+ */
+range_result parse_range(const str_ref & spec, off_t size, off_t & start, off_t & length) {
+    const char * p = spec.data, * end = spec.data + spec.len;
+    if (spec.len < 6 || strncasecmp(p, "bytes=", 6)) return RANGE_NONE;
+    p += 6;
+    if (find_byte(p, end, ',')) return RANGE_NONE;
+    off_t first, last;
+    p = scan_offset(p, end, first);
+    if (p == end || *p != '-') return RANGE_NONE;
+    if (scan_offset(p + 1, end, last) != end) return RANGE_NONE;
+    if (first == -1) {
+        if (last == -1) return RANGE_NONE;
+        if (last == 0 || size == 0) return RANGE_UNSATISFIABLE;
+        start = size - std::min(last, size);
+        length = size - start;
+        return RANGE_OK;
+    }
+    if (last != -1 && last < first) return RANGE_NONE;
+    if (first >= size) return RANGE_UNSATISFIABLE;
+    if (last == -1 || last >= size) last = size - 1;
+    start = first;
+    length = last - first + 1;
+    return RANGE_OK;
+}
+
+/*
+ * Turns response for a whole file into 206 or 416 when the GET request asks for a range.
+ * With If-Range the range is honoured only if the file is still the one client has part of.
+ */
+void select_range(http_request * req, http_response & resp) {
+    resp.file_size = resp.content_length;
+    str_ref range = req->parsed->header("Range");
+    if (range.empty()) return;
+    str_ref validator = req->parsed->header("If-Range");
+    if (!validator.empty()) {
+        char date[HTTP_DATE_LENGTH];
+        size_t len = format_http_date(resp.mod_time, date);
+        /* Entity tag is compared strongly, a weak one never matches */
+        if (validator.data[0] == '"') {
+            if (validator.len != resp.etag_len || memcmp(validator.data, resp.etag, resp.etag_len)) return;
+        }
+        else if (validator.len != len || memcmp(validator.data, date, len)) return;
+    }
+    off_t start, length;
+    switch (parse_range(range, resp.file_size, start, length)) {
+        case RANGE_OK:
+            resp.req_status = HTTP_STATUS_CODE_PARTIAL;
+            resp.range_start = start;
+            resp.content_length = length;
+            break;
+        case RANGE_UNSATISFIABLE:
+            resp.req_status = HTTP_STATUS_CODE_RANGE;
+            resp.content_length = 0;
+            resp.content_type = resp.cache_control = NULL;
+            break;
+        case RANGE_NONE:
+            break;
+    }
+}
+
+/*
+ * Helper method writes entity tag of a file into buf and returns its length.
+ * Replacing the file changes the inode, rewriting it changes size or mtime.
+ */
+size_t format_etag(const struct stat & info, char * buf) {
+    unsigned long long mtime = (unsigned long long)info.st_mtim.tv_sec * 1000000000ULL + info.st_mtim.tv_nsec;
+    return snprintf(buf, ETAG_MAX_LENGTH, "\"%llx-%llx-%llx\"", (unsigned long long)info.st_ino,
+                    (unsigned long long)info.st_size, mtime);
+}
+
+/* Checks If-None-Match list against an entity tag with weak comparison (RFC 7232, 2.3.2) */
+bool etag_matches(const str_ref & list, const str_ref & etag) {
+    const char * p = list.data, * end = list.data + list.len;
+    while (p < end) {
+        if (*p == ' ' || *p == '\t' || *p == ',') {
+            p++;
+            continue;
+        }
+        if (*p == '*') return true;
+        if (end - p > 2 && p[0] == 'W' && p[1] == '/') p += 2;
+        if (*p != '"') return false;
+        const char * close = find_byte(p + 1, end, '"');
+        if (!close) return false;
+        if ((size_t)(close + 1 - p) == etag.len && !memcmp(p, etag.data, etag.len)) return true;
+        p = close + 1;
+    }
+    return false;
+}
+
+/* Helper method parses RFC 1123 date, returns -1 for anything else */
+time_t parse_http_date(const str_ref & value) {
+    char buf[HTTP_DATE_LENGTH];
+    if (value.len >= sizeof(buf)) return -1;
+    memcpy(buf, value.data, value.len);
+    buf[value.len] = '\0';
+    struct tm t;
+    memset(&t, 0, sizeof(t));
+    const char * end = strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &t);
+    if (!end || *end) return -1;
+    return timegm(&t);
+}
+
+/*
+ * Evaluates If-None-Match, or If-Modified-Since when there is no entity tag
+ * list (RFC 7232, 6). Response must already carry the file's validators.
+ */
+bool not_modified(http_request * req, http_response & resp) {
+    str_ref tags = req->parsed->header("If-None-Match");
+    if (!tags.empty()) return etag_matches(tags, str_ref(resp.etag, resp.etag_len));
+    str_ref since = req->parsed->header("If-Modified-Since");
+    if (since.empty()) return false;
+    time_t stamp = parse_http_date(since);
+    return stamp != -1 && resp.mod_time <= stamp;
+}
+
+/*
+ * Helper method writes RFC 1123 date into buf. Returns its length. Names are
+ * fixed English ones whatever the locale, so fields are filled in directly
+ * instead of going through strftime, which dominated building a header
+ */
+size_t format_http_date(time_t stamp, char * buf) {
+    static const char days[] = "SunMonTueWedThuFriSat";
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    struct tm t;
+    if (!gmtime_r(&stamp, &t)) return 0;
+    int year = t.tm_year + 1900;
+    if (year < 1000 || year > 9999) return strftime(buf, HTTP_DATE_LENGTH, "%a, %d %b %Y %T GMT", &t);
+    char * p = buf;
+    memcpy(p, days + 3 * t.tm_wday, 3);
+    p[3] = ',';
+    p[4] = ' ';
+    p[5] = '0' + t.tm_mday / 10;
+    p[6] = '0' + t.tm_mday % 10;
+    p[7] = ' ';
+    memcpy(p + 8, months + 3 * t.tm_mon, 3);
+    p[11] = ' ';
+    p[12] = '0' + year / 1000;
+    p[13] = '0' + year / 100 % 10;
+    p[14] = '0' + year / 10 % 10;
+    p[15] = '0' + year % 10;
+    p[16] = ' ';
+    p[17] = '0' + t.tm_hour / 10;
+    p[18] = '0' + t.tm_hour % 10;
+    p[19] = ':';
+    p[20] = '0' + t.tm_min / 10;
+    p[21] = '0' + t.tm_min % 10;
+    p[22] = ':';
+    p[23] = '0' + t.tm_sec / 10;
+    p[24] = '0' + t.tm_sec % 10;
+    memcpy(p + 25, " GMT", 5);
+    return 29;
+}
+
+/*
+ * Date header changes once a second, so the reactor formats it on its timer tick.
+ * Two slots let workers read one while the other is being rewritten.
+ */
+void refresh_date() {
+    int next = 1 - date_slot.load(std::memory_order_relaxed);
+    format_http_date(time(0), date_cache[next]);
+    date_slot.store(next, std::memory_order_release);
 }
 
-void build_response_header(http_response & resp) {
-    std::stringstream header;
-    header << SERVER_HTTP_PROTOCOL_VERSION << " " << get_status_as_string(resp.req_status) << '\n';
-    header << "Date: " << get_time_in_gmt() << '\n';
-    header << "Server: " << SERVER_INFO << '\n';
-    if (resp.mod_time)
-        header << "Last-Modified: " << get_time_in_gmt(resp.mod_time) << '\n';
-    if (!resp.content_type.empty())
-        header << "Content-Type: " << resp.content_type << '\n';
-    if (resp.content_length)
-        header << "Content-Length: " << resp.content_length << '\n';
-    header << '\n';
-    resp.header = header.str();
+const char * current_date() {
+    return date_cache[date_slot.load(std::memory_order_acquire)];
 }
 
 /*
- * Helper method fills up resp.content with content of requested file or with
- * content of directory in HTML format.
+ * Helper method prepares response for requested file or directory. Small files
+ * and listings end up in the cache, bigger files are left open for the worker
+ * to stream, so memory per request doesn't grow with the size of the file.
  */
 void get_file_content(http_request *req, http_response &resp) {
     struct stat f_info;
-    std::ifstream in_f;
     /* Check if path is an empty string */
     if (req->norm_path.empty()) {
         resp.req_status = HTTP_STATUS_CODE_BAD_REQUEST;
         return;
     }
     /* Get stat for a file */
-    stat(req->norm_path.c_str(), &f_info);
+    STATS(uint64_t stat_start = stats_now());
+    int found = docroot.stat_path(req->norm_path, &f_info);
+    STATS(stats_record(STAGE_STAT, stat_start));
+    if (found == -1) {
+        resp.req_status = HTTP_STATUS_CODE_NOTFOUND;
+        return;
+    }
     /* If openned file is a directory then get list of files */
+    /* HEAD builds the listing too, so it reports the same length as GET */
     if (S_ISDIR(f_info.st_mode)) {
-        if (get_method_as_int(req->method) == HTTP_REQUEST_GET) {
-            std::stringstream listing;
-            int dir;
-            struct dirent **item;
-            dir = scandir(req->norm_path.c_str(), &item, NULL, alphasort);
-            listing << "<html>\n<head><title>Directory Listing</title></head>\n<body>\n"
-                    << "<h2>Listing of " << req->page << ":</h2><br>\n";
-            for(int i=0; i<dir; i++) {
-                if (item[i]->d_name[0] != '.') {
-                    listing << item[i]->d_name << "<br>\n";
-                }
-                free(item[i]);
-            }
-            free(item);
-            listing << "</body>\n</html>\n";
-            resp.content_length = listing.str().length();
-            resp.content = new char[resp.content_length];
-            strcpy(resp.content, listing.str().c_str());
-            resp.content_type = TYPE_MIME_TEXT_HTML;
-        }
         resp.req_status = HTTP_STATUS_CODE_OK;
-        resp.mod_time = f_info.st_mtimespec.tv_sec;
+        get_directory_listing(req, f_info, resp);
+        if (resp.req_status == HTTP_STATUS_CODE_OK) resp.mod_time = f_info.st_mtime;
     }
     /* Its a file */
     else if (S_ISREG(f_info.st_mode)) {
-        switch(get_file_extension(req->norm_path.c_str())){
-            case HTML:
-                in_f.open(req->norm_path);
-                if (!in_f.is_open()) {
-                    resp.req_status = HTTP_STATUS_CODE_NOTFOUND;
-                    break;
-                }
-                if (get_method_as_int(req->method) == HTTP_REQUEST_GET) {
-                    resp.content = new char[f_info.st_size];
-                    in_f.read(resp.content, f_info.st_size);
-                    resp.content_length = f_info.st_size;
-                }
-                resp.content_type = TYPE_MIME_TEXT_HTML;
-                resp.req_status = HTTP_STATUS_CODE_OK;
-                resp.mod_time = f_info.st_mtimespec.tv_sec;
-                break;
-            case JPEG:
-                in_f.open(req->norm_path, std::ios::binary);
-                if (!in_f.is_open()) {
-                    resp.req_status = HTTP_STATUS_CODE_NOTFOUND;
-                    break;
-                }
-                if (get_method_as_int(req->method) == HTTP_REQUEST_GET) {
-                    resp.content = new char[f_info.st_size];
-                    in_f.read(resp.content, f_info.st_size);
-                    resp.content_length = f_info.st_size;
-                }
-                resp.content_type = TYPE_MIME_IMAGE_JPEG;
-                resp.req_status = HTTP_STATUS_CODE_OK;
-                resp.mod_time = f_info.st_mtimespec.tv_sec;
-                break;
-            default:
-                resp.req_status = HTTP_STATUS_CODE_BAD_REQUEST;
-        in_f.close();
+        mime_type mime = mime_lookup(req->norm_path.data(), req->norm_path.length());
+        resp.content_type = mime.type;
+        resp.cache_control = mime_cache_control(mime.cls);
+        /* Client's copy is still valid, neither cache nor file is touched */
+        resp.mod_time = f_info.st_mtime;
+        resp.etag_len = format_etag(f_info, resp.etag);
+        if (not_modified(req, resp)) {
+            resp.content_type = NULL;
+            resp.req_status = HTTP_STATUS_CODE_NOT_MODIFIED;
+            return;
+        }
+        /* Cache hit costs a lookup, file isn't even opened */
+        if (content.admits(f_info.st_size)
+            && (resp.cached = content.get(req->norm_path, file_version(f_info)))) {
+            resp.content_length = f_info.st_size;
+            resp.req_status = HTTP_STATUS_CODE_OK;
+            if (get_method_as_int(req->method) == HTTP_REQUEST_GET) select_range(req, resp);
+            return;
+        }
+        int fd = open(req->norm_path.c_str(), O_RDONLY);
+        if (fd == -1 || fstat(fd, &f_info) == -1) {
+            resp.req_status = open_error_status(errno);
+            if (fd != -1) close(fd);
+            resp.content_type = NULL;
+            resp.mod_time = 0;
+            resp.etag_len = 0;
+            return;
+        }
+        resp.content_length = f_info.st_size;
+        resp.req_status = HTTP_STATUS_CODE_OK;
+        resp.mod_time = f_info.st_mtime;
+        resp.etag_len = format_etag(f_info, resp.etag);
+        if (get_method_as_int(req->method) != HTTP_REQUEST_GET) {
+            close(fd);
+            return;
+        }
+        select_range(req, resp);
+        if (resp.req_status == HTTP_STATUS_CODE_RANGE) {
+            close(fd);
+            return;
         }
+        /*
+         * Small files are loaded into the cache together with their entity header.
+         * Concurrent misses on the same file read it once and share that copy
+         */
+        bool leader = false;
+        if (content.admits(f_info.st_size)
+            && (resp.cached = content.join_load(req->norm_path, file_version(f_info), leader))) {
+            close(fd);
+            return;
+        }
+        if (leader) {
+            std::shared_ptr<cache_entry> entry = std::make_shared<cache_entry>();
+            entry->version = file_version(f_info);
+            entry->body.resize(f_info.st_size);
+            bool loaded = read_all(fd, &entry->body[0], f_info.st_size);
+            if (loaded) {
+                header_builder header;
+                append_entity_header(header, f_info.st_mtime, str_ref(resp.etag, resp.etag_len), resp.content_type,
+                                     resp.cache_control, f_info.st_size, true);
+                entry->header.assign(header.data(), header.length());
+            }
+            content.finish_load(req->norm_path, loaded ? entry : NULL);
+            if (loaded) {
+                resp.cached = entry;
+                close(fd);
+                return;
+            }
+        }
+        /* Bigger files are never held in memory, worker streams them after the header */
+        resp.file_fd = fd;
     }
     else resp.req_status = HTTP_STATUS_CODE_NOTFOUND;
 }
 
-std::string get_logstring(http_request * req, http_response & resp) {
-        std::stringstream out;
-        out     << req->rem_ip << " ~ [" << get_time_for_logging(req->timestamp) << "] ["
-                << get_time_for_logging() << "] \"" << req->method << " " << req->page
-                << " " << req->http << "\" " << resp.req_status << " "
-                << resp.content_length << std::endl;
-        return out.str();
+/* Helper method sends scattered buffers through a non-blocking socket, resuming after partial writes */
+bool send_iov(int fd, struct iovec * iov, int cnt) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = cnt;
+    while (msg.msg_iovlen) {
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            if (poll(&pfd, 1, -1) == -1 && errno != EINTR) return false;
+            continue;
+        }
+        STATS(stats_sent(n));
+        /* Skip buffers that were sent completely and advance into the partial one */
+        while (msg.msg_iovlen && (size_t)n >= msg.msg_iov->iov_len) {
+            n -= msg.msg_iov->iov_len;
+            msg.msg_iov++;
+            msg.msg_iovlen--;
+        }
+        if (msg.msg_iovlen) {
+            msg.msg_iov->iov_base = (char *)msg.msg_iov->iov_base + n;
+            msg.msg_iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+#ifdef SERVER_STATS
+/* Renders live statistics into a response body that is never cached */
+void get_server_status(http_request * req, http_response & resp) {
+    std::shared_ptr<cache_entry> entry = std::make_shared<cache_entry>();
+    str_ref path = request_path(req->page);
+    bool json = req->page.len > path.len
+                && str_ref(path.data + path.len + 1, req->page.len - path.len - 1).equals("json");
+    int workers = 0, ready = 0;
+    for (shard * sh : shards) {
+        workers += sh->workers.load();
+        ready += sh->ready_workers.load();
+    }
+    cache_counters cache = content.counters();
+    if (json) stats.render_json(entry->body, workers, ready, cache);
+    else stats.render_text(entry->body, workers, ready, cache);
+    resp.content_type = json ? TYPE_MIME_APPLICATION_JSON : TYPE_MIME_TEXT_PLAIN;
+    header_builder header;
+    append_entity_header(header, 0, str_ref(), resp.content_type, "no-store", entry->body.length(), false);
+    entry->header.assign(header.data(), header.length());
+    resp.cached = entry;
+    resp.content_length = entry->body.length();
+    resp.req_status = HTTP_STATUS_CODE_OK;
+}
+#endif
+
+/*
+ * Helper method fills up response with HTML listing of a directory. Listing is
+ * cached like a file and rebuilt when directory's version changes. Directories with
+ * more than DIR_LISTING_MAX_ENTRIES entries are not built in memory, worker streams them.
+ */
+void get_directory_listing(http_request * req, struct stat & f_info, http_response & resp) {
+    const std::string & key = req->norm_path;
+    resp.content_type = TYPE_MIME_TEXT_HTML;
+    if ((resp.cached = content.get(key, file_version(f_info)))) {
+        resp.content_length = resp.cached->body.length();
+        return;
+    }
+    DIR * dir = opendir(req->norm_path.c_str());
+    /* Directory that can't be read gets an error, not an empty listing */
+    if (!dir) {
+        resp.req_status = open_error_status(errno);
+        resp.content_type = NULL;
+        return;
+    }
+    std::vector<std::string> names;
+    struct dirent * item;
+    while ((item = readdir(dir))) {
+        if (item->d_name[0] == '.') continue;
+        if (names.size() == DIR_LISTING_MAX_ENTRIES) {
+            rewinddir(dir);
+            resp.stream_dir = dir;
+            /* Length is unknown, HTTP/1.0 client learns where body ends from closed connection */
+            resp.chunked = req->http.equals("HTTP/1.1");
+            if (!resp.chunked) req->keep_alive = false;
+            return;
+        }
+        names.push_back(item->d_name);
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end(),
+              [](const std::string & a, const std::string & b) { return strcoll(a.c_str(), b.c_str()) < 0; });
+    std::shared_ptr<cache_entry> entry = std::make_shared<cache_entry>();
+    entry->version = file_version(f_info);
+    entry->body = listing_prologue(req->norm_path);
+    for (const std::string & name : names) {
+        append_html(entry->body, name.c_str());
+        entry->body.append("<br>\n");
+    }
+    entry->body.append(LISTING_EPILOGUE);
+    header_builder header;
+    append_entity_header(header, f_info.st_mtime, str_ref(), TYPE_MIME_TEXT_HTML, NULL, entry->body.length(), false);
+    entry->header.assign(header.data(), header.length());
+    if (content.admits(entry->body.length())) content.put(key, entry);
+    resp.cached = entry;
+    resp.content_length = entry->body.length();
+}
+
+/*
+ * Title is made from the normalized path, so every spelling of a directory
+ * gets the same listing and nothing the client sent reaches the page
+ */
+std::string listing_prologue(const std::string & norm_path) {
+    std::string title;
+    if (norm_path[0] == '.') title = norm_path.substr(1);
+    else title = "~" + norm_path.substr(home_root.length());
+    std::string prologue = "<html>\n<head><title>Directory Listing</title></head>\n<body>\n<h2>Listing of ";
+    append_html(prologue, title.c_str());
+    return prologue + ":</h2><br>\n";
+}
+
+/* Helper method appends text with characters special to HTML escaped */
+void append_html(std::string & out, const char * text) {
+    for (; *text; text++) {
+        switch (*text) {
+            case '&': out.append("&amp;"); break;
+            case '<': out.append("&lt;"); break;
+            case '>': out.append("&gt;"); break;
+            case '"': out.append("&quot;"); break;
+            default: out.push_back(*text);
+        }
+    }
+}
+
+/*
+ * Helper method streams listing of a huge directory in LISTING_CHUNK_SIZE pieces,
+ * with chunked transfer coding if the client supports it. Memory use doesn't
+ * depend on number of entries. Entries are not sorted
+ */
+bool stream_listing(int sock, DIR * dir, const std::string & norm_path, bool chunked) {
+    fixed_buffer<LISTING_CHUNK_SIZE> chunk;
+    std::string prologue = listing_prologue(norm_path), name;
+    struct dirent * item;
+    chunk.append(prologue);
+    bool done = false;
+    while (!done) {
+        while ((item = readdir(dir))) {
+            if (item->d_name[0] == '.') continue;
+            name.clear();
+            append_html(name, item->d_name);
+            chunk.append(name);
+            chunk.append("<br>\n");
+            /* Escaped name takes up to 6 bytes per character */
+            if (chunk.length() > LISTING_CHUNK_SIZE - 6 * NAME_MAX - 8) break;
+        }
+        if (!item) {
+            chunk.append(LISTING_EPILOGUE);
+            done = true;
+        }
+        if (!send_chunk(sock, chunk.data(), chunk.length(), chunked)) return false;
+        chunk.clear();
+    }
+    /* Last chunk has zero length */
+    return !chunked || send_all(sock, "0\r\n\r\n", 5);
+}
+
+/* Helper method sends a piece of body, framed as a chunk when chunked coding is used */
+bool send_chunk(int sock, const char * data, size_t len, bool chunked) {
+    if (!chunked) return send_all(sock, data, len);
+    char size[20];
+    struct iovec iov[3] = {
+        {size, (size_t)snprintf(size, sizeof(size), "%zx\r\n", len)},
+        {(void *)data, len},
+        {(void *)"\r\n", 2}
+    };
+    return send_iov(sock, iov, 3);
+}
+
+/* Helper method reads exactly len bytes of a file into buf */
+bool read_all(int fd, char * buf, size_t len) {
+    off_t offset = 0;
+    while (len) {
+        ssize_t n = pread(fd, buf, len, offset);
+        if (n > 0) {
+            buf += n;
+            len -= n;
+            offset += n;
+        }
+        else if (n == -1 && errno == EINTR) continue;
+        else return false;
+    }
+    return true;
+}
+
+/*
+ * Helper method sends count bytes of a file through a non-blocking socket with
+ * sendfile(). Partial writes resume from the offset advanced by the kernel.
+ * Falls back to buffered copy if the file system doesn't support sendfile().
+ */
+bool send_file(int sock, int fd, off_t offset, size_t count) {
+    while (count) {
+        ssize_t n = sendfile(sock, fd, &offset, count);
+        if (n > 0) {
+            STATS(stats_sent(n));
+            count -= n;
+        }
+        else if (n == -1 && errno == EINTR) continue;
+        else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {sock, POLLOUT, 0};
+            if (poll(&pfd, 1, -1) == -1 && errno != EINTR) return false;
+        }
+        else if (n == -1 && (errno == EINVAL || errno == ENOSYS))
+            return send_file_buffered(sock, fd, offset, count);
+        /* File was truncated while being sent */
+        else return false;
+    }
+    return true;
+}
+
+/* Buffered fallback for send_file(). Memory use is bounded by SEND_BUFFER_SIZE */
+bool send_file_buffered(int sock, int fd, off_t offset, size_t count) {
+    char buf[SEND_BUFFER_SIZE];
+    while (count) {
+        ssize_t n = pread(fd, buf, std::min(count, sizeof(buf)), offset);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0 || !send_all(sock, buf, n)) return false;
+        offset += n;
+        count -= n;
+    }
+    return true;
+}
+
+/* Formats access log line into worker's buffer */
+void get_logstring(http_request * req, http_response & resp, log_line & out) {
+    char stamp[LOG_TIME_LENGTH];
+    out.clear();
+    out.append(req->rem_ip);
+    out.append(" ~ [");
+    out.append(stamp, format_log_time(req->timestamp, stamp));
+    out.append("] [");
+    out.append(stamp, format_log_time(time(0), stamp));
+    out.append("] \"");
+    out.append(req->method.data, req->method.len);
+    out.append(" ");
+    out.append(req->page.data, req->page.len);
+    out.append(" ");
+    out.append(req->http.data, req->http.len);
+    out.append("\" ");
+    out.append_number(resp.req_status);
+    out.append(" ");
+    out.append_number(resp.content_length);
+    out.terminate_line();
+}
+
+void content_cache::set_capacity(size_t bytes) {
+    std::lock_guard<std::mutex> lg(this->m);
+    this->capacity = bytes;
+    this->evict(0);
+}
+
+/* File is cached only if it takes a small share of the budget, bigger ones go through sendfile() */
+bool content_cache::admits(off_t size) const {
+    return size >= 0 && (size_t)size <= this->capacity / CACHE_MAX_ENTRY_SHARE;
+}
+
+/* Returns cached file if it is still valid and marks it most recently used */
+std::shared_ptr<const cache_entry> content_cache::get(const std::string & key, const file_version & version) {
+    std::lock_guard<std::mutex> lg(this->m);
+    auto it = this->index.find(key);
+    if (it == this->index.end()) {
+        this->misses++;
+        return NULL;
+    }
+    std::shared_ptr<const cache_entry> entry = it->second->second;
+    /* File changed on disk since it was loaded */
+    if (entry->version != version) {
+        this->used -= entry->body.length();
+        this->lru.erase(it->second);
+        this->index.erase(it);
+        this->misses++;
+        return NULL;
+    }
+    this->lru.splice(this->lru.begin(), this->lru, it->second);
+    this->hits++;
+    return entry;
+}
+
+/* Inserts or replaces an entry. Entries being sent stay alive until their last user is done */
+void content_cache::put(const std::string & key, std::shared_ptr<const cache_entry> entry) {
+    std::lock_guard<std::mutex> lg(this->m);
+    this->insert(key, entry);
+}
+
+/*
+ * Single flight for a miss. The first caller gets NULL with leader set and must
+ * call finish_load(). Callers for the same version of the file arriving meanwhile
+ * wait and get the loaded entry, or NULL if loading failed. Entry cached since the
+ * caller's miss is returned right away
+ */
+std::shared_ptr<const cache_entry> content_cache::join_load(const std::string & key, const file_version & version,
+                                                            bool & leader) {
+    std::unique_lock<std::mutex> lk(this->m);
+    leader = false;
+    auto it = this->index.find(key);
+    if (it != this->index.end() && it->second->second->version == version) {
+        this->lru.splice(this->lru.begin(), this->lru, it->second);
+        return it->second->second;
+    }
+    auto p = this->loading.find(key);
+    if (p == this->loading.end()) {
+        this->loading[key] = std::make_shared<pending_load>(version);
+        leader = true;
+        return NULL;
+    }
+    /* Another version is being loaded, caller reads the file on its own */
+    std::shared_ptr<pending_load> pending = p->second;
+    if (pending->version != version) return NULL;
+    this->coalesced++;
+    this->loaded.wait(lk, [&pending] { return pending->done; });
+    return pending->entry;
+}
+
+/* Publishes result of a load started by join_load() and wakes those waiting for it */
+void content_cache::finish_load(const std::string & key, std::shared_ptr<const cache_entry> entry) {
+    std::unique_lock<std::mutex> lk(this->m);
+    auto p = this->loading.find(key);
+    p->second->entry = entry;
+    p->second->done = true;
+    this->loading.erase(p);
+    if (entry) this->insert(key, entry);
+    lk.unlock();
+    this->loaded.notify_all();
+}
+
+/* Caller holds lock */
+void content_cache::insert(const std::string & key, std::shared_ptr<const cache_entry> entry) {
+    if (entry->body.length() > this->capacity) return;
+    auto it = this->index.find(key);
+    if (it != this->index.end()) {
+        this->used -= it->second->second->body.length();
+        this->lru.erase(it->second);
+        this->index.erase(it);
+    }
+    this->evict(entry->body.length());
+    this->lru.push_front(std::make_pair(key, entry));
+    this->index[key] = this->lru.begin();
+    this->used += entry->body.length();
 }
 
-void Log::openlogfile(std::string path) {
-    this->_logfile.open(path, std::ios::app);
+/* Drops least recently used entries until there is room for given number of bytes. Caller holds lock */
+void content_cache::evict(size_t room) {
+    while (!this->lru.empty() && this->used + room > this->capacity) {
+        this->used -= this->lru.back().second->body.length();
+        this->index.erase(this->lru.back().first);
+        this->lru.pop_back();
+        this->evictions++;
+    }
 }
 
-void Log::execute(std::string log_str) {
+cache_counters content_cache::counters() {
     std::lock_guard<std::mutex> lg(this->m);
-    if (serv_params.debugging)
-        std::cout << log_str;
-    else if (this->_logfile.is_open())
-        this->_logfile << log_str << std::flush;
-}
-
-void scheduling_thread() {
-    if (serv_params.debugging) print_debugging_message();
-    else sleep(serv_params.q_time);
-    std::vector<std::thread> pool;
-    /* Creating pool of threads, respecting condition variables,
-    mutexes and request slots */
-    for (int id=0; id<serv_params.threads; id++) {
-        mutex_wt.push_back(new std::mutex);
-        cv_wt.push_back(new std::condition_variable());
-        jobs.push_back(NULL);
-        pool.push_back(std::thread (worker_thread, id));
+    cache_counters c;
+    c.hits = this->hits;
+    c.misses = this->misses;
+    c.evictions = this->evictions;
+    c.coalesced = this->coalesced;
+    c.entries = this->lru.size();
+    c.used = this->used;
+    c.capacity = this->capacity;
+    return c;
+}
+
+std::string content_cache::stats() {
+    cache_counters c = this->counters();
+    std::stringstream out;
+    out     << "cache: hits=" << c.hits << " misses=" << c.misses
+            << " evictions=" << c.evictions << " coalesced=" << c.coalesced
+            << " entries=" << c.entries
+            << " bytes=" << c.used << "/" << c.capacity << '\n';
+    return out.str();
+}
+
+/*
+ * Opens log and starts background writer. Every producer thread gets its own ring
+ * so appending a line never takes a lock. In debugging mode log goes to standard output
+ */
+void Log::open(const std::string & path, int producers) {
+    if (serv_params.debugging) this->fd = STDOUT_FILENO;
+    else if (path.empty()) return;
+    else if ((this->fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644)) == -1)
+        pr_error("failed open logfile");
+    for (int i=0; i<producers; i++) this->rings.push_back(new log_ring(LOG_RING_SIZE));
+    this->writer_thread = std::thread(&Log::writer, this);
+}
+
+/*
+ * Copies line into producer's ring. When ring is full line is either dropped
+ * or producer waits for the writer, depending on overflow policy.
+ */
+void Log::append(int producer, const char * line, size_t len) {
+    if (this->fd == -1) return;
+    log_ring * ring = this->rings[producer];
+    while (!ring->push(line, len)) {
+        if (serv_params.log_drop || len > ring->capacity()) {
+            this->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        this->request_flush();
+        usleep(LOG_BLOCK_WAIT);
     }
+    /* Ask for an early flush when ring is getting full */
+    if (ring->size() > ring->capacity() / 2) this->request_flush();
+}
+
+void Log::request_flush() {
+    if (!this->flush_requested.exchange(true)) this->cv.notify_one();
+}
+
+/* Stops the writer after it flushed everything appended so far */
+void Log::close() {
+    if (this->fd == -1) return;
+    std::unique_lock<std::mutex> lk(this->m);
+    this->stopping = true;
+    lk.unlock();
+    this->cv.notify_one();
+    this->writer_thread.join();
+    if (this->fd != STDOUT_FILENO) ::close(this->fd);
+    this->fd = -1;
+}
+
+/* Background thread batching lines of all producers into large write() calls */
+void Log::writer() {
+    std::vector<char> batch(LOG_BATCH_SIZE);
+    uint64_t reported = 0;
+    std::unique_lock<std::mutex> lk(this->m);
     while (true) {
-        /* Lock mutex */
-        std::unique_lock<std::mutex> mql(mutex_rq);
-        /* Wait for notification or when queue is not empty */
-        cv_rq.wait(mql, [](){return !request_queue->empty();});
-        /****************** Critical section ****************/
-        /* Get request at the front of the queue and pop it */
-        struct http_request * req = request_queue->top();
-        request_queue->pop();
-        /****************************************************/
-        mql.unlock();
-        /* Looking for a waiting thread */
-        for(int i=0;; i = (i+1) % serv_params.threads) {
-            if (jobs[i] == NULL) {
-                jobs[i] = req;
-                cv_wt[i]->notify_one();
-                break;
+        this->cv.wait_for(lk, std::chrono::milliseconds(serv_params.log_flush_ms),
+                          [this](){ return this->stopping || this->flush_requested.load(); });
+        this->flush_requested.store(false);
+        bool stop = this->stopping;
+        lk.unlock();
+        size_t len = 0;
+        for (log_ring * ring : this->rings) {
+            size_t n;
+            while ((n = ring->pop(batch.data() + len, batch.size() - len))) {
+                len += n;
+                if (len == batch.size()) {
+                    this->write_batch(batch.data(), len);
+                    len = 0;
+                }
             }
-            /* If all threads are busy sleep for 200us */
-            else if (i == serv_params.threads-1)
-                usleep(200);
         }
+        uint64_t dropped = this->dropped.load(std::memory_order_relaxed);
+        if (dropped != reported && batch.size() - len >= LOG_LINE_MAX) {
+            log_line note;
+            note.append("log: dropped ");
+            note.append_number(dropped - reported);
+            note.append(" lines");
+            note.terminate_line();
+            memcpy(batch.data() + len, note.data(), note.length());
+            len += note.length();
+            reported = dropped;
+        }
+        this->write_batch(batch.data(), len);
+        lk.lock();
+        if (stop) break;
+    }
+}
+
+void Log::write_batch(const char * buf, size_t len) {
+    while (len) {
+        ssize_t n = write(this->fd, buf, len);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return;
+        buf += n;
+        len -= n;
     }
 }
 
-void worker_thread(int id) {
-    while(true) {
-        std::unique_lock<std::mutex> w_locker(*mutex_wt[id]);
-        cv_wt[id]->wait(w_locker, [=](){return jobs[id] != NULL;});
+log_ring::log_ring(size_t size) {
+    this->buf = new char[size];
+    this->mask = size - 1;
+    this->head.store(0);
+    this->tail.store(0);
+}
+
+/* Publishes whole line or nothing, so the writer never sees half of it */
+bool log_ring::push(const char * line, size_t len) {
+    size_t tail = this->tail.load(std::memory_order_relaxed);
+    size_t head = this->head.load(std::memory_order_acquire);
+    if (this->capacity() - (tail - head) < len) return false;
+    size_t off = tail & this->mask, first = std::min(len, this->capacity() - off);
+    memcpy(this->buf + off, line, first);
+    memcpy(this->buf, line + first, len - first);
+    this->tail.store(tail + len, std::memory_order_release);
+    return true;
+}
+
+/* Moves up to cap bytes into out. Returns number of bytes moved */
+size_t log_ring::pop(char * out, size_t cap) {
+    size_t head = this->head.load(std::memory_order_relaxed);
+    size_t tail = this->tail.load(std::memory_order_acquire);
+    size_t len = std::min(tail - head, cap);
+    size_t off = head & this->mask, first = std::min(len, this->capacity() - off);
+    memcpy(out, this->buf + off, first);
+    memcpy(out + first, this->buf, len - first);
+    this->head.store(head + len, std::memory_order_release);
+    return len;
+}
+
+size_t log_ring::size() const {
+    return this->tail.load(std::memory_order_relaxed) - this->head.load(std::memory_order_relaxed);
+}
+
+/*
+ * Waits for queuing time so requests pile up in the main queue, then starts the
+ * minimum pool of workers. Workers take requests from the work queue on their own,
+ * more are added by the reactor and they retire by themselves.
+ */
+void scheduling_thread(shard * sh) {
+    if (serv_params.debugging && sh->id == 0) print_debugging_message();
+    else wait_for_stop(serv_params.q_time);
+    if (stopping.load()) return;
+    for (int w=0; w<serv_params.min_threads; w++)
+        if (!spawn_worker(sh)) pr_error("cannot start worker thread");
+}
+
+/*
+ * Worker is an index into the shard's slots, its id is its slot in the log and
+ * statistics, unique across shards. A retired worker's slot is taken by the next one started
+ */
+void worker_thread(shard * sh, int worker) {
+    int id = worker_producer(sh, worker);
+    header_builder header;
+    log_line line;
+    if (sh->cpu != -1) pin_thread(sh->cpu);
+    STATS(stats_bind(id));
+    /* Announce readiness so the reactor hands over queued requests */
+    sh->ready_workers.fetch_add(1);
+    sh->starting.fetch_sub(1);
+    wake_reactor(sh);
+    while (wait_for_work(sh)) {
+        struct http_request * req = NULL;
+        /* Semaphore is posted only after a successful push so pop can't fail */
+        sh->work_queue->pop(req);
+        STATS(uint64_t mark = stats_record(STAGE_QUEUE, req->dispatched));
         struct http_response resp;
-        switch (get_method_as_int(jobs[id]->method)) {
+        switch (get_method_as_int(req->method)) {
             case HTTP_REQUEST_GET:
             case HTTP_REQUEST_HEAD:
-            get_file_content(jobs[id], resp);
+#ifdef SERVER_STATS
+            if (request_path(req->page).equals(SERVER_STATUS_PATH)) {
+                get_server_status(req, resp);
+                break;
+            }
+#endif
+            get_file_content(req, resp);
             break;
             default:
             resp.req_status = HTTP_STATUS_CODE_BAD_REQUEST;
         }
-        build_response_header(resp);
-        send(jobs[id]->con_fd, resp.header.c_str(), strlen(resp.header.c_str()), 0);
-        if (resp.content_length) {
-            send(jobs[id]->con_fd, resp.content, resp.content_length, 0);
-            delete [] resp.content;
-            resp.content = NULL;
+        /* Malformed request can't be followed reliably on the same connection */
+        if (resp.req_status == HTTP_STATUS_CODE_BAD_REQUEST)
+            req->keep_alive = false;
+        resp.keep_alive = req->keep_alive;
+        STATS(mark = stats_record(STAGE_CONTENT, mark));
+        build_response_header(resp, header);
+        STATS(mark = stats_record(STAGE_HEADER, mark));
+        bool sent;
+        if (resp.stream_dir) {
+            sent = get_method_as_int(req->method) == HTTP_REQUEST_HEAD
+                   ? send_all(req->con_fd, header.data(), header.length())
+                   : send_all(req->con_fd, header.data(), header.length(), MSG_MORE)
+                   && stream_listing(req->con_fd, resp.stream_dir, req->norm_path, resp.chunked);
+            closedir(resp.stream_dir);
+            resp.stream_dir = NULL;
+        }
+        else if (resp.file_fd != -1) {
+            /* Header is corked with MSG_MORE so it leaves in the same segment as the file */
+            sent = send_all(req->con_fd, header.data(), header.length(), MSG_MORE)
+                   && (serv_params.zero_copy
+                       ? send_file(req->con_fd, resp.file_fd, resp.range_start, resp.content_length)
+                       : send_file_buffered(req->con_fd, resp.file_fd, resp.range_start, resp.content_length));
+            close(resp.file_fd);
+            resp.file_fd = -1;
+        }
+        else {
+            /* Header and body that are already in memory leave with a single system call */
+            struct iovec iov[2] = {{(void *)header.data(), header.length()}, {NULL, 0}};
+            if (resp.cached && get_method_as_int(req->method) == HTTP_REQUEST_GET)
+                iov[1] = {(void *)(resp.cached->body.data() + resp.range_start), (size_t)resp.content_length};
+            sent = send_iov(req->con_fd, iov, iov[1].iov_len ? 2 : 1);
+        }
+        STATS(stats_record(STAGE_SEND, mark));
+        STATS(stats_record(STAGE_TOTAL, req->dispatched));
+        STATS(stats_response(resp.req_status));
+        /* Connection is unusable after a failed write */
+        if (!sent) req->keep_alive = false;
+        if (logging.enabled()) {
+            get_logstring(req, resp, line);
+            logging.append(id, line.data(), line.length());
+        }
+        /* Worker is ready before reactor learns about completion, so it can feed the next request */
+        sh->ready_workers.fetch_add(1);
+        complete_request(req);
+    }
+    /* Slot is given back last, nothing is logged or recorded through it afterwards */
+    std::lock_guard<std::mutex> lg(sh->pool_mutex);
+    sh->free_slots.push_back(worker);
+    sh->running.fetch_sub(1);
+}
+
+/*
+ * Waits for a request. Returns false when the worker idled long enough and retired,
+ * or when the server is stopping. Request left in the work queue then is never served
+ */
+bool wait_for_work(shard * sh) {
+    if (!elastic_pool()) {
+        while (sem_wait(&sh->work_available) == -1);
+        return !stopping.load();
+    }
+    while (true) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += serv_params.pool_idle_s;
+        int r;
+        while ((r = sem_timedwait(&sh->work_available, &deadline)) == -1 && errno == EINTR);
+        if (stopping.load()) return false;
+        if (r == 0) return true;
+        if (retire_worker(sh)) return false;
+    }
+}
+
+bool elastic_pool() {
+    return serv_params.min_threads < serv_params.threads;
+}
+
+/* Starts a worker unless the pool is at its maximum. Size is reserved by CAS first so the bound holds */
+bool spawn_worker(shard * sh) {
+    int n = sh->workers.load();
+    do {
+        if (n >= serv_params.threads) return false;
+    } while (!sh->workers.compare_exchange_weak(n, n + 1));
+    std::unique_lock<std::mutex> lg(sh->pool_mutex);
+    /* Worker that just retired may still hold its slot, the next attempt finds it free */
+    if (sh->free_slots.empty()) {
+        sh->workers.fetch_sub(1);
+        return false;
+    }
+    int worker = sh->free_slots.back();
+    sh->free_slots.pop_back();
+    lg.unlock();
+    sh->starting.fetch_add(1);
+    sh->running.fetch_add(1);
+    try {
+        std::thread(worker_thread, sh, worker).detach();
+    }
+    catch (const std::system_error &) {
+        sh->starting.fetch_sub(1);
+        sh->running.fetch_sub(1);
+        lg.lock();
+        sh->free_slots.push_back(worker);
+        lg.unlock();
+        sh->workers.fetch_sub(1);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * How long the request next in line has waited in ms, or -1 if a worker can't
+ * help it: some are idle or starting, the pool is full or nothing may run.
+ * Every worker being busy means they are all blocked on disk or on sending.
+ */
+int64_t pool_wait(shard * sh) {
+    int n = sh->workers.load();
+    if (!elastic_pool() || n == 0 || n >= serv_params.threads || sh->ready_workers.load() > 0
+        || sh->starting.load() > 0) return -1;
+    /* Request held back by the policy counts too, SPLIT's large share grows with the pool */
+    sched_job * next = sh->sched->head();
+    if (!next) return -1;
+    return monotonic_ms() - next->arrived;
+}
+
+/*
+ * Adds a worker once the next request waited pool_grow_ms with every worker busy.
+ * One is started at a time and the next only after it became ready, so a burst
+ * grows the pool step by step instead of to its maximum at once. Called by the reactor
+ */
+void grow_pool(shard * sh) {
+    int64_t waited = pool_wait(sh);
+    if (waited < serv_params.pool_grow_ms) return;
+    STATS(int busy = sh->workers.load());
+    if (!spawn_worker(sh)) return;
+    STATS(stats.pool_changed(pool_event{time(0), sh->id, true, busy + 1, busy, (uint64_t)waited}));
+}
+
+/* Timeout of the reactor's wait, so growth isn't delayed until the next event. -1 when not needed */
+int pool_timeout(shard * sh) {
+    int64_t waited = pool_wait(sh);
+    if (waited < 0) return -1;
+    /* At least a ms, a pool that can't start a thread isn't polled in a busy loop */
+    return std::max<int64_t>(1, serv_params.pool_grow_ms - waited);
+}
+
+/*
+ * Called by a worker that idled pool_idle_s. Its readiness is given up first so
+ * the reactor can't hand it a request meanwhile. If the reactor already did, the
+ * request is on its way and the worker stays. Pool never shrinks below its minimum.
+ */
+bool retire_worker(shard * sh) {
+    if (!claim_ready_worker(sh)) return false;
+    int n = sh->workers.load();
+    do {
+        if (n <= serv_params.min_threads) {
+            sh->ready_workers.fetch_add(1);
+            /* Reactor may have found no ready worker meanwhile and left requests waiting */
+            wake_reactor(sh);
+            return false;
+        }
+    } while (!sh->workers.compare_exchange_weak(n, n - 1));
+    STATS(stats.pool_changed(pool_event{time(0), sh->id, false, n - 1, n - 1 - sh->ready_workers.load(), 0}));
+    return true;
+}
+
+/*
+ * Takes one ready worker, or returns false if there is none. Reactor handing
+ * out a request and a worker retiring both claim readiness this way, so the
+ * count never goes below zero when they race for the last ready worker
+ */
+bool claim_ready_worker(shard * sh) {
+    int ready = sh->ready_workers.load();
+    do {
+        if (ready <= 0) return false;
+    } while (!sh->ready_workers.compare_exchange_weak(ready, ready - 1));
+    return true;
+}
+
+/* Helper method registers descriptor in shard's reactor */
+void reactor_add(shard * sh, int fd, uint32_t events) {
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.fd = fd;
+    if (epoll_ctl(sh->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        pr_error("cannot register descriptor in epoll");
+}
+
+/* Accepts every pending connection. Listening socket is edge-triggered so drain it */
+void accept_connections(shard * sh) {
+    while (true) {
+        struct sockaddr_in con_info;
+        socklen_t con_socklen = sizeof(con_info);
+        int con_fd = accept4(sh->socket_fd, (struct sockaddr *) &con_info, &con_socklen, SOCK_NONBLOCK);
+        if (con_fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            /* EAGAIN means backlog is empty. Anything else (EMFILE...) is retried on next event */
+            return;
+        }
+        /* Recycled connection keeps the input buffer it grew before */
+        object_pool<connection>::handle conn = sh->connection_pool.acquire();
+        conn->owner = sh;
+        conn->fd = con_fd;
+        conn->in_buf.clear();
+        conn->parser.reset();
+        conn->busy = false;
+        conn->served = 0;
+        conn->waiting_since = time(0);
+        strcpy(conn->rem_ip, get_ip(&con_info).c_str());
+        conn->addr = ntohl(con_info.sin_addr.s_addr);
+        if ((size_t)con_fd >= sh->connections.size()) sh->connections.resize(con_fd + 1, NULL);
+        sh->connections[con_fd] = conn.release();
+        reactor_add(sh, con_fd, EPOLLIN | EPOLLRDHUP | EPOLLET);
+        STATS(stats.accepted++);
+        STATS(stats.open_connections++);
+    }
+}
+
+/* Removes connection from the reactor and closes its socket */
+void close_connection(connection * conn) {
+    epoll_ctl(conn->owner->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    shard * sh = conn->owner;
+    sh->connections[conn->fd] = NULL;
+    sh->connection_pool.adopt(conn);
+    STATS(stats.open_connections--);
+}
+
+/*
+ * Reads everything available on the connection. Socket is edge-triggered so
+ * reading continues until EAGAIN. Request is dispatched once header is complete.
+ * Connection that is being served is left alone, worker hands it back when done.
+ */
+void read_connection(connection * conn) {
+    char chunk[REACTOR_READ_CHUNK];
+    if (conn->busy) return;
+    while (true) {
+        /* Pipelined request may already sit in the buffer */
+        parse_result res = conn->parser.parse(conn->in_buf.data(), conn->in_buf.length());
+        if (res == PARSE_DONE) {
+            dispatch_request(conn, conn->parser.length());
+            return;
+        }
+        /* Malformed or oversized header is dispatched empty so worker answers with 400 */
+        if (res == PARSE_ERROR || conn->in_buf.length() >= HEADER_MAX_LENGTH) {
+            dispatch_request(conn, 0);
+            return;
+        }
+        ssize_t n = recv(conn->fd, chunk, sizeof(chunk), 0);
+        if (n > 0) {
+            /* Header's deadline runs from its first byte, a client trickling bytes doesn't extend it */
+            if (conn->in_buf.empty()) conn->waiting_since = time(0);
+            conn->in_buf.append(chunk, n);
+        }
+        else if (n == -1 && errno == EINTR) continue;
+        else if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        else {
+            /* Peer closed connection or error occurred */
+            close_connection(conn);
+            return;
+        }
+    }
+}
+
+/* Decides whether connection stays open after the response (RFC 7230, 6.3) */
+bool wants_keep_alive(const http_parser & parser, int served) {
+    if (serv_params.keepalive_timeout <= 0 || served + 1 >= serv_params.keepalive_max)
+        return false;
+    str_ref con = parser.header("Connection");
+    if (parser.version.equals("HTTP/1.1"))
+        return !con.iequals("close");
+    if (parser.version.equals("HTTP/1.0"))
+        return con.iequals("keep-alive");
+    return false;
+}
+
+/*
+ * Builds request object from connection's buffer and puts it into the main queue.
+ * Connection stays in the reactor but is busy until the worker hands it back, so
+ * pipelined requests are answered one by one in order of arrival.
+ */
+void dispatch_request(connection * conn, size_t header_len) {
+    shard * sh = conn->owner;
+    uint64_t now = monotonic_ms();
+    /*
+     * Overload is answered right away, nothing is allocated for a rejected request.
+     * Queue is checked first so a request shed with 503 doesn't spend the client's token
+     */
+    bool queue_full = serv_params.queue_max && sh->sched->size() >= serv_params.queue_max;
+    int retry_after = queue_full ? 0 : limiter.take(conn->addr, now);
+    if (queue_full || retry_after) {
+        http_request rejected;
+        init_request(&rejected, conn, header_len);
+        if (retry_after) shed_request(&rejected, HTTP_STATUS_CODE_TOO_MANY, retry_after);
+        else shed_request(&rejected, HTTP_STATUS_CODE_UNAVAILABLE, SERVER_RETRY_AFTER);
+        return;
+    }
+    /* Creating object that represents client request, recycled from the shard's pool */
+    object_pool<http_request>::handle request = sh->request_pool.acquire();
+    init_request(request.get(), conn, header_len);
+    request->arrived = now;
+    normalize_path(request->page, request->norm_path);
+    STATS(uint64_t stat_start = stats_now());
+    request->size = get_filesize(&request->norm_path);
+    STATS(request->dispatched = stats_record(STAGE_STAT, stat_start));
+    request->seq = sh->request_seq++;
+    conn->busy = true;
+    /* Put request object into the shard's queue. Only its reactor touches it, queue owns it until completion */
+    sh->sched->push(request.release());
+    STATS(stats.queue_depth++);
+    feed_workers(sh);
+}
+
+/* Fills request fields taken from the connection and its parsed header */
+void init_request(http_request * request, connection * conn, size_t header_len) {
+    /* Malformed request leaves method empty so worker answers with 400 and closes connection */
+    request->method = request->page = request->http = str_ref();
+    request->parsed = NULL;
+    request->keep_alive = false;
+    if (header_len) {
+        request->method = conn->parser.method;
+        request->page = conn->parser.target;
+        request->http = conn->parser.version;
+        request->parsed = &conn->parser;
+        request->keep_alive = wants_keep_alive(conn->parser, conn->served);
+    }
+    request->conn = conn;
+    request->header_len = header_len;
+    request->con_fd = conn->fd;
+    request->timestamp = time(0);
+    strcpy(request->rem_ip, conn->rem_ip);
+    request->client = conn->addr;
+}
+
+/*
+ * Takes one token from client's bucket. Returns 0 if request may proceed,
+ * otherwise seconds until the bucket holds a token again
+ */
+int rate_limiter::take(uint32_t addr, uint64_t now) {
+    if (serv_params.rate_limit <= 0) return 0;
+    stripe & s = this->stripe_of(addr);
+    std::lock_guard<std::mutex> lg(s.m);
+    token_bucket & b = s.buckets.emplace(addr, token_bucket{serv_params.rate_burst, now}).first->second;
+    /* Another shard may have read the clock later and refilled already */
+    if (now > b.updated) {
+        b.tokens = std::min(serv_params.rate_burst, b.tokens + (now - b.updated) * serv_params.rate_limit / 1000);
+        b.updated = now;
+    }
+    if (b.tokens >= 1) {
+        b.tokens -= 1;
+        return 0;
+    }
+    return 1 + (int)((1 - b.tokens) / serv_params.rate_limit);
+}
+
+/* Forgets buckets that are full again, a returning client starts with a full one anyway */
+void rate_limiter::prune(uint64_t now) {
+    for (stripe & s : this->stripes) {
+        std::lock_guard<std::mutex> lg(s.m);
+        for (auto it = s.buckets.begin(); it != s.buckets.end(); ) {
+            const token_bucket & b = it->second;
+            /* Bucket another shard used after now was read is kept */
+            if (b.updated <= now
+                && b.tokens + (now - b.updated) * serv_params.rate_limit / 1000 >= serv_params.rate_burst)
+                it = s.buckets.erase(it);
+            else ++it;
+        }
+    }
+}
+
+/*
+ * Answers request on the reactor without serving it. A single non-blocking write
+ * is tried, a client that can't take a few hundred bytes loses the answer. Connection
+ * is closed so nothing pipelined behind the request is read
+ */
+void shed_request(http_request * req, int status, int retry_after) {
+    header_builder header;
+    http_response resp;
+    resp.req_status = status;
+    resp.retry_after = retry_after;
+    build_response_header(resp, header);
+    STATS(ssize_t sent =) send(req->con_fd, header.data(), header.length(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    STATS(stats_response(status));
+    STATS(if (sent > 0) stats_sent(sent));
+    if (logging.enabled()) {
+        log_line line;
+        get_logstring(req, resp, line);
+        logging.append(reactor_producer(req->conn->owner), line.data(), line.length());
+    }
+    close_connection(req->conn);
+}
+
+/* Helper method returns monotonic time in milliseconds */
+uint64_t monotonic_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Moves requests from the main queue to the work queue, one per ready worker.
+ * Keeping the rest in the main queue preserves the policy's order among waiting
+ * requests while idle workers pick up work without a scheduler in between.
+ * Policy may hold requests back even with workers ready, SPLIT does.
+ * Request that waited past the deadline is shed instead, the client is better
+ * served by a quick 503 than by an answer it may have given up on.
+ */
+void feed_workers(shard * sh) {
+    uint64_t now = serv_params.deadline_ms > 0 ? monotonic_ms() : 0;
+    /* Workers retire on their own, the policy learns the pool's size before it picks */
+    int n = sh->workers.load();
+    if (n != sh->sched_workers) sh->sched->resize(sh->sched_workers = n);
+    while (sh->ready_workers.load() > 0) {
+        http_request * req = static_cast<http_request *>(sh->sched->next());
+        if (!req) break;
+        if (now && now - req->arrived > (uint64_t)serv_params.deadline_ms) {
+            sh->sched->pop();
+            sh->sched->done(req);
+            STATS(stats.queue_depth--);
+            object_pool<http_request>::handle owned = sh->request_pool.adopt(req);
+            shed_request(req, HTTP_STATUS_CODE_UNAVAILABLE, SERVER_RETRY_AFTER);
+            continue;
+        }
+        /* Worker that retired since the loop condition was checked takes its readiness along */
+        if (!claim_ready_worker(sh)) break;
+        /* Slot may still be held by a worker that was preempted while popping, retried on next wakeup */
+        if (!sh->work_queue->push(req)) {
+            sh->ready_workers.fetch_add(1);
+            break;
         }
-        logging.execute(get_logstring(jobs[id], resp));
-        close(jobs[id]->con_fd);
-        delete jobs[id];
-        jobs[id] = NULL;
+        sh->sched->pop();
+        STATS(stats.queue_depth--);
+        sem_post(&sh->work_available);
+    }
+    grow_pool(sh);
+}
+
+/* Called by a worker when response is sent. Hands connection back to its reactor */
+void complete_request(http_request * req) {
+    shard * sh = req->conn->owner;
+    std::unique_lock<std::mutex> mcl(sh->mutex_done);
+    sh->completed.push_back(req);
+    mcl.unlock();
+    wake_reactor(sh);
+}
+
+/* Helper method interrupts reactor's epoll_wait() */
+void wake_reactor(shard * sh) {
+    uint64_t one = 1;
+    if (write(sh->wakeup_fd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+        perror("cannot wake up reactor");
+}
+
+/*
+ * Takes back connections whose responses were sent. Connection is either closed
+ * or its next (possibly already buffered) request is processed.
+ */
+void collect_completed(shard * sh) {
+    uint64_t counter;
+    while (read(sh->wakeup_fd, &counter, sizeof(counter)) > 0);
+    std::unique_lock<std::mutex> mcl(sh->mutex_done);
+    sh->collected.swap(sh->completed);
+    mcl.unlock();
+    for (http_request * req : sh->collected) {
+        /* Request goes back to the pool at the end of the iteration */
+        object_pool<http_request>::handle owned = sh->request_pool.adopt(req);
+        sh->sched->done(req);
+        connection * conn = req->conn;
+        conn->busy = false;
+        conn->served++;
+        conn->waiting_since = time(0);
+        if (!req->keep_alive) close_connection(conn);
+        else {
+            conn->in_buf.erase(0, req->header_len);
+            conn->parser.reset();
+            read_connection(conn);
+        }
+    }
+    sh->collected.clear();
+    feed_workers(sh);
+}
+
+/*
+ * Closes connections that stayed idle for longer than keep-alive timeout.
+ * Keep-alive timeout only covers the gap between requests, a client still
+ * sending its header (or yet to send the first one) gets the header timeout
+ * counted from the header's start, however slowly the bytes trickle in
+ */
+void close_idle_connections(shard * sh) {
+    time_t now = time(0);
+    std::vector<connection *> idle;
+    for (connection * conn : sh->connections) {
+        if (!conn || conn->busy) continue;
+        bool between = conn->served > 0 && conn->in_buf.empty();
+        int timeout = between ? serv_params.keepalive_timeout : SERVER_HEADER_TIMEOUT;
+        if (now - conn->waiting_since >= timeout) idle.push_back(conn);
+    }
+    for (connection * conn : idle) close_connection(conn);
+}
+
+/*
+ * SIGUSR1 writes cache statistics to the log. SIGTERM and SIGINT stop the
+ * server, the log is flushed once workers are gone so its tail isn't lost
+ */
+void handle_signals() {
+    struct signalfd_siginfo info;
+    while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGUSR1) {
+            /* Without a log file counters would be dropped, they go to standard error instead */
+            std::string stats = content.stats();
+            if (logging.enabled()) logging.append(reactor_producer(shards[0]), stats.data(), stats.length());
+            else std::cerr << stats;
+        }
+        /* Log is closed by main() once every worker that appends to it has finished */
+        else request_stop();
+    }
+}
+
+/* Tells reactors and scheduling threads to stop, each reactor then stops its workers */
+void request_stop() {
+    std::unique_lock<std::mutex> lk(stop_mutex);
+    stopping.store(true);
+    lk.unlock();
+    stop_cv.notify_all();
+    for (shard * sh : shards) wake_reactor(sh);
+}
+
+/* Sleeps for given number of seconds or until the server is stopping. Returns true in the latter case */
+bool wait_for_stop(int seconds) {
+    std::unique_lock<std::mutex> lk(stop_mutex);
+    return stop_cv.wait_for(lk, std::chrono::seconds(seconds), [](){ return stopping.load(); });
+}
+
+/*
+ * Called by a stopping reactor after its scheduling thread finished, so no more
+ * workers are started. Sockets are shut down so a worker blocked sending to a
+ * slow client fails at once, idle workers are woken until every thread returned.
+ */
+void stop_workers(shard * sh) {
+    for (connection * conn : sh->connections)
+        if (conn) shutdown(conn->fd, SHUT_RDWR);
+    while (sh->running.load() > 0) {
+        sem_post(&sh->work_available);
+        usleep(SHUTDOWN_POLL_WAIT);
     }
 }
 
 /* Queuing thread */
+/*
+ * Helper method sets up a shard: its listener, reactor descriptors and queues.
+ * Workers are started by the shard's scheduling thread.
+ */
+shard * create_shard(int id) {
+    shard * sh = new shard();
+    sh->id = id;
+    /* A single shard is left to the kernel scheduler like before sharding */
+    if (serv_params.shards > 1) sh->cpu = id % sysconf(_SC_NPROCESSORS_ONLN);
+    sh->ready_workers = 0;
+    sh->workers = 0;
+    sh->starting = 0;
+    sh->running = 0;
+    for (int w=serv_params.threads-1; w>=0; w--) sh->free_slots.push_back(w);
+    sh->sched = make_scheduler(serv_params.policy, serv_params.sched, serv_params.threads);
+    sh->sched_workers = serv_params.threads;
+    sh->socket_fd = create_socket_open_port();
+    /* Registering listening socket in the reactor */
+    if ((sh->epoll_fd = epoll_create1(0)) == -1)
+        pr_error("cannot create epoll instance");
+    reactor_add(sh, sh->socket_fd, EPOLLIN | EPOLLET);
+    /* Workers wake the reactor up through eventfd when they hand connections back */
+    if ((sh->wakeup_fd = eventfd(0, EFD_NONBLOCK)) == -1)
+        pr_error("cannot create eventfd");
+    reactor_add(sh, sh->wakeup_fd, EPOLLIN | EPOLLET);
+    /* Timer ticks once a second to close idle connections, first shard also refreshes Date header */
+    struct itimerspec tick = {{1, 0}, {1, 0}};
+    if ((sh->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) == -1
+        || timerfd_settime(sh->timer_fd, 0, &tick, NULL) == -1)
+        pr_error("cannot create timer");
+    reactor_add(sh, sh->timer_fd, EPOLLIN | EPOLLET);
+    /* Headroom keeps a slow consumer from making the ring look full */
+    sh->work_queue = new mpmc_queue<http_request *>(2 * serv_params.threads);
+    sem_init(&sh->work_available, 0, 0);
+    return sh;
+}
+
+/* Helper method binds calling thread to a CPU */
+void pin_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set))
+        std::cerr << "cannot pin thread to CPU " << cpu << "\n";
+}
+
+/* Log and statistics slots: workers of all shards first, then one per reactor */
+int worker_producer(shard * sh, int worker) {
+    return sh->id * serv_params.threads + worker;
+}
+
+int reactor_producer(shard * sh) {
+    return serv_params.shards * serv_params.threads + sh->id;
+}
+
+/* Reactor loop: accepting connections and reading requests as bytes arrive */
+void reactor_loop(shard * sh) {
+    if (sh->cpu != -1) pin_thread(sh->cpu);
+    STATS(stats_bind(reactor_producer(sh)));
+    /* Creating scheduling thread */
+    std::thread scheduler(scheduling_thread, sh);
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    while (!stopping.load()) {
+        int n = epoll_wait(sh->epoll_fd, events, REACTOR_MAX_EVENTS, pool_timeout(sh));
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            pr_error("epoll_wait failed");
+        }
+        /* Request waited for a worker long enough to add one */
+        if (n == 0) feed_workers(sh);
+        for (int i=0; i<n; i++) {
+            if (events[i].data.fd == sh->socket_fd) {
+                accept_connections(sh);
+                continue;
+            }
+            if (events[i].data.fd == sh->wakeup_fd) {
+                collect_completed(sh);
+                continue;
+            }
+            if (events[i].data.fd == signal_fd) {
+                handle_signals();
+                continue;
+            }
+            if (events[i].data.fd == docroot.fd()) {
+                docroot.process_events();
+                continue;
+            }
+            if (events[i].data.fd == sh->timer_fd) {
+                uint64_t expirations;
+                while (read(sh->timer_fd, &expirations, sizeof(expirations)) > 0);
+                if (sh->id == 0) refresh_date();
+                close_idle_connections(sh);
+                if (sh->id == 0 && serv_params.rate_limit > 0) limiter.prune(monotonic_ms());
+                feed_workers(sh);
+                continue;
+            }
+            int fd = events[i].data.fd;
+            connection * conn = (size_t)fd < sh->connections.size() ? sh->connections[fd] : NULL;
+            if (!conn || conn->busy) continue;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) close_connection(conn);
+            else read_connection(conn);
+        }
+    }
+    scheduler.join();
+    stop_workers(sh);
+}
+
+/* Built with -DMYHTTPD_NO_MAIN the server's functions are linked into microbench and the parser tests */
+#ifndef MYHTTPD_NO_MAIN
 int main(int argc, char * argv[]) {
-    request_queue = new std::priority_queue<http_request *, std::vector<http_request *>,
-                        std::function<bool(http_request *, http_request *)>>(compare_time);
     /* Parsing command line arguments */
     parse_args(argc, argv);
+    /* Relative path is taken from where the server was started, before changing directory */
+    if (!serv_params.mime_file.empty() && !mime_load(serv_params.mime_file))
+        pr_error("cannot read MIME types file");
     /* Run as daemon if not in debugging mode */
     if (!serv_params.debugging) daemon_mode();
     /* Changing root directory for the server */
     chdir(serv_params.root_dir.c_str());
-    /* Open logfile if given */
-    if (!serv_params.logfile.empty()) {
-        try { logging.openlogfile(serv_params.logfile); }
-        catch (...) {
-        pr_error("failed open logfile");
-        }
-    }
-    create_socket_open_port();
-    /* Creating scheduling thread */
-    std::thread scheduler(scheduling_thread);
-    /* Accepting and queuing requests */
-    while (true) {
-        char    header[HEAD_LINE_LENGTH] = {'\0'}, method[METHOD_LENGTH] = {'\0'},
-                page[PAGE_LENGTH] = {'\0'}, http[HTTP_LENGTH] = {'\0'};
-
-        con_fd = accept(socket_fd, (struct sockaddr *) &con_info, &con_socklen);
-        recv(con_fd, header, HEAD_LINE_LENGTH, 0);
-        sscanf(header, "%5s %1024s %8s", method, page, http);
-        /* Creating object that represents client request*/
-        struct http_request * request = new http_request();
-        request->con_fd = con_fd;
-        request->norm_path = normalize_path(page);
-        request->f_size = get_filesize(&request->norm_path);
-        request->timestamp = time(0);
-        strcpy(request->method, method);
-        strcpy(request->page, page);
-        strcpy(request->http, http);
-        strcpy(request->rem_ip, get_ip(&con_info).c_str());
-        /* Lock mutex */
-        std::unique_lock<std::mutex> mql(mutex_rq);
-        /************* Critical section ***********/
-        /* Put request object into the main queue */
-        request_queue->push(request);
-        /******************************************/
-        mql.unlock();
-        /* Notify scheduler thread that there is a new request in the main queue */
-        cv_rq.notify_one();
+    /* Client gone mid-response must fail the write, not kill the server. sendfile() has no MSG_NOSIGNAL */
+    signal(SIGPIPE, SIG_IGN);
+    /* Home directory is looked up once, requests starting with ~ are served from there */
+    struct passwd * pw = getpwuid(getuid());
+    if (pw && pw->pw_dir) home_root = std::string(pw->pw_dir) + "/myhttpd";
+    /*
+     * Signals are taken by the first reactor through signalfd. They are blocked before any
+     * thread is created so every thread inherits the mask
+     */
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+    /* Open log, workers and reactors of all shards append to it */
+    int producers = serv_params.shards * (serv_params.threads + 1);
+    logging.open(serv_params.logfile, producers);
+    /* Statistics have the same slots as the log */
+    STATS(stats.init(producers));
+    content.set_capacity(serv_params.cache_size);
+    refresh_date();
+    for (int id=0; id<serv_params.shards; id++)
+        shards.push_back(create_shard(id));
+    if ((signal_fd = signalfd(-1, &signals, SFD_NONBLOCK)) == -1)
+        pr_error("cannot create signalfd");
+    reactor_add(shards[0], signal_fd, EPOLLIN | EPOLLET);
+    /* Index is updated by the first reactor, every thread reads it */
+    if (serv_params.doc_index) {
+        std::vector<std::string> roots(1, ".");
+        char * cwd = realpath(".", NULL), * home = home_root.empty() ? NULL : realpath(home_root.c_str(), NULL);
+        struct stat home_info;
+        if (home && strcmp(home, cwd ? cwd : "") && !stat(home, &home_info) && S_ISDIR(home_info.st_mode))
+            roots.push_back(home_root);
+        free(cwd);
+        free(home);
+        if (docroot.open(roots)) reactor_add(shards[0], docroot.fd(), EPOLLIN | EPOLLET);
     }
-    scheduler.join();
-    /* Cleaning up */
-    close(socket_fd);
+    /* Main thread runs the first shard's reactor, others get their own thread */
+    std::vector<std::thread> reactors;
+    for (int id=1; id<serv_params.shards; id++)
+        reactors.push_back(std::thread(reactor_loop, shards[id]));
+    reactor_loop(shards[0]);
+    for (std::thread & t : reactors) t.join();
+    /* Cleaning up, workers are gone so nothing appends to the log anymore */
+    logging.close();
     freeaddrinfo(socket_info);
 
     return EXIT_SUCCESS;
 }
+#endif
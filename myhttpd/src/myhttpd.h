@@ -1,15 +1,21 @@
 #ifndef MYHTTPD_H
 #define MYHTTPD_H
 
+#include <atomic>
 #include <condition_variable>
 #include <functional>
 #include <iostream>
 #include <thread>
 #include <sstream>      // string stream
-#include <fstream>      // file stream
+#include <chrono>
 #include <vector>
 #include <queue>
+#include <algorithm>
 #include <mutex>
+#include <list>
+#include <memory>
+#include <limits>
+#include <signal.h>
 #include <sys/stat.h>   // stat systemcall
 #include <unistd.h>     // gethostname() gethostbyname()
 #include <time.h>       // time functions
@@ -19,23 +25,88 @@
 #include <arpa/inet.h>  // inet functions
 #include <dirent.h>     // dirscan function
 #include <pwd.h>        // needed to get a path of user's homedirectory
+#include "http_parser.h"
+#include "stats.h"
+#include "docroot_index.h"
+#include "pool.h"
+#include "mime.h"
+#include "scheduler.h"
+#include <fcntl.h>      // non-blocking sockets
+#include <poll.h>       // waiting for a socket to become writable
+#include <sys/epoll.h>  // event notification for the reactor
+#include <sys/eventfd.h>// waking reactor up from worker threads
+#include <sys/sendfile.h>// zero-copy file transfer
+#include <semaphore.h>  // parking idle workers
+#include <sys/timerfd.h>// reactor's clock tick
+#include <sys/uio.h>    // scatter-gather output
+#include <sys/signalfd.h>// signals delivered to the reactor
+#include <sched.h>      // pinning shards to CPUs
+#include <unordered_map>
 
 /* Server settings */
 #define SERVER_INFO                         "myhttpd/0.0.1"
-#define SERVER_HTTP_PROTOCOL_VERSION        "HTTP/1.0"
+#define SERVER_HTTP_PROTOCOL_VERSION        "HTTP/1.1"
 #define SERVER_DEFAULT_PORT                 "8080"
 #define SERVER_DEFAULT_ROOT_DIR             ""
 #define SERVER_DEFAULT_Q_TIME               60
 #define SERVER_DEFAULT_N_THREADS            4
-#define SERVER_DEFAULT_FCFS                 true
+#define SERVER_DEFAULT_POOL_GROW            10      // ms the next request waits with every worker busy before one is added
+#define SERVER_DEFAULT_POOL_IDLE            30      // seconds a worker above the minimum may idle before it exits
+#define SERVER_DEFAULT_SHARDS               1
+#define SERVER_DEFAULT_POLICY               "FCFS"
 #define SERVER_DEFAULT_DEBUGGING            false
+#define SERVER_DEFAULT_KEEPALIVE_TIMEOUT    5       // seconds
+#define SERVER_DEFAULT_KEEPALIVE_MAX        100     // requests per connection
+/* Seconds a client may take to send a complete request header */
+#define SERVER_HEADER_TIMEOUT               10
+#define SERVER_DEFAULT_ZERO_COPY            true
+#define SERVER_DEFAULT_CACHE_SIZE           (64 << 20)  // bytes
+#define SERVER_DEFAULT_LOG_FLUSH            200     // ms
+#define SERVER_DEFAULT_LOG_DROP             false
+#define SERVER_DEFAULT_DOC_INDEX            true
+#define SERVER_DEFAULT_QUEUE_MAX            1024    // waiting requests per shard, 0 is unbounded
+#define SERVER_DEFAULT_DEADLINE             0       // ms a request may wait, 0 disables shedding
+#define SERVER_DEFAULT_RATE_LIMIT           0       // requests per second per client, 0 disables it
+/* Rate limiter's buckets are split over this many locks */
+#define RATE_LIMIT_STRIPES                  64
+/* Seconds a client rejected for a full queue is asked to wait */
+#define SERVER_RETRY_AFTER                  1
 #define SERVER_INDEX_FILE                   "index.html"
 
-/* Limits for 1st line */
-#define HEAD_LINE_LENGTH                    1040
-#define METHOD_LENGTH                       6       // 5 + EOL
-#define PAGE_LENGTH                         1025    // 1024 + EOL
-#define HTTP_LENGTH                         9      // 8 + EOL
+/* Reactor settings */
+#define REACTOR_MAX_EVENTS                  256
+#define REACTOR_READ_CHUNK                  4096
+
+/* Asynchronous log: per-thread ring size (power of two), writer's batch and longest line */
+#define LOG_RING_SIZE                       65536
+#define LOG_BATCH_SIZE                      (256 << 10)
+#define LOG_LINE_MAX                        (HEADER_MAX_LENGTH + 256)
+#define LOG_TIME_LENGTH                     32
+#define LOG_BLOCK_WAIT                      100     // us a producer sleeps waiting for room
+
+/* Microseconds a stopping reactor sleeps between checks for workers still running */
+#define SHUTDOWN_POLL_WAIT                  1000
+
+/* Largest cacheable file as a fraction of cache size */
+#define CACHE_MAX_ENTRY_SHARE               8
+
+/* Directories with more entries are streamed instead of being built and cached */
+#define DIR_LISTING_MAX_ENTRIES             4096
+#define LISTING_CHUNK_SIZE                  16384
+#define LISTING_EPILOGUE                    "</body>\n</html>\n"
+
+/* Size of the stack buffer used when sendfile() is not available */
+#define SEND_BUFFER_SIZE                    65536
+
+/* Limit for request header */
+#define HEADER_MAX_LENGTH                   8192
+
+/* Response header buffer and length of RFC 1123 date including EOL */
+#define HEADER_BUFFER_SIZE                  2048
+#define HTTP_DATE_LENGTH                    30
+
+/* Quoted "inode-size-mtime" entity tag in hex including terminating NUL */
+#define ETAG_MAX_LENGTH                     56
 
 /* Accepting methods as string */
 #define HTTP_REQUEST_GET_S                  "GET"
@@ -47,59 +118,366 @@
 
 /* Status codes as integers */
 #define HTTP_STATUS_CODE_OK                 200
+#define HTTP_STATUS_CODE_PARTIAL            206
+#define HTTP_STATUS_CODE_NOT_MODIFIED       304
 #define HTTP_STATUS_CODE_BAD_REQUEST        400
+#define HTTP_STATUS_CODE_FORBIDDEN          403
 #define HTTP_STATUS_CODE_NOTFOUND           404
+#define HTTP_STATUS_CODE_RANGE              416
+#define HTTP_STATUS_CODE_TOO_MANY           429
+#define HTTP_STATUS_CODE_UNAVAILABLE        503
 
 /* Status codes as strings */
 #define HTTP_STATUS_CODE_OK_S               "200 OK"
+#define HTTP_STATUS_CODE_PARTIAL_S          "206 Partial Content"
+#define HTTP_STATUS_CODE_NOT_MODIFIED_S     "304 Not Modified"
 #define HTTP_STATUS_CODE_BAD_REQUEST_S      "400 Bad Request"
+#define HTTP_STATUS_CODE_FORBIDDEN_S        "403 Forbidden"
 #define HTTP_STATUS_CODE_NOTFOUND_S         "404 Not Found"
+#define HTTP_STATUS_CODE_RANGE_S            "416 Range Not Satisfiable"
+#define HTTP_STATUS_CODE_TOO_MANY_S         "429 Too Many Requests"
+#define HTTP_STATUS_CODE_UNAVAILABLE_S      "503 Service Unavailable"
 
-/* Supported MIME types */
-#define TYPE_MIME_IMAGE_JPEG                "image/jpeg"
+/* MIME types of generated responses, files are typed by src/mime.cpp */
 #define TYPE_MIME_TEXT_HTML                 "text/html"
+#define TYPE_MIME_TEXT_PLAIN                "text/plain"
+#define TYPE_MIME_APPLICATION_JSON          "application/json"
+
+/* Built-in page with live statistics, "?json" selects machine-readable output */
+#define SERVER_STATUS_PATH                  "/server-status"
 
 /* Structure holds default parameters of the server */
 static struct parameters {
     bool debugging = SERVER_DEFAULT_DEBUGGING;
-    std::string port = SERVER_DEFAULT_PORT, logfile;
+    std::string port = SERVER_DEFAULT_PORT, logfile, mime_file;
     std::string root_dir = SERVER_DEFAULT_ROOT_DIR;
     int q_time = SERVER_DEFAULT_Q_TIME;
-    int threads = SERVER_DEFAULT_N_THREADS;
-    bool fcfs_policy = SERVER_DEFAULT_FCFS;
+    int threads = SERVER_DEFAULT_N_THREADS;     // most workers of each shard
+    int min_threads = SERVER_DEFAULT_N_THREADS; // workers a shard keeps, pool is fixed when equal to threads
+    int pool_grow_ms = SERVER_DEFAULT_POOL_GROW;
+    int pool_idle_s = SERVER_DEFAULT_POOL_IDLE;
+    int shards = SERVER_DEFAULT_SHARDS;
+    std::string policy = SERVER_DEFAULT_POLICY;
+    sched_params sched;
+    int keepalive_timeout = SERVER_DEFAULT_KEEPALIVE_TIMEOUT;
+    int keepalive_max = SERVER_DEFAULT_KEEPALIVE_MAX;
+    bool zero_copy = SERVER_DEFAULT_ZERO_COPY;
+    size_t cache_size = SERVER_DEFAULT_CACHE_SIZE;
+    int log_flush_ms = SERVER_DEFAULT_LOG_FLUSH;
+    bool log_drop = SERVER_DEFAULT_LOG_DROP;
+    bool doc_index = SERVER_DEFAULT_DOC_INDEX;
+    size_t queue_max = SERVER_DEFAULT_QUEUE_MAX;
+    int deadline_ms = SERVER_DEFAULT_DEADLINE;
+    double rate_limit = SERVER_DEFAULT_RATE_LIMIT, rate_burst = SERVER_DEFAULT_RATE_LIMIT;
 } serv_params;
 
-struct http_request {
+struct connection;
+
+/* Scheduling fields come from sched_job: arrival order and time, size estimate */
+struct http_request : public sched_job {
+    struct connection * conn;
+#ifdef SERVER_STATS
+    uint64_t dispatched;    // monotonic time it was handed to the scheduler
+#endif
+    size_t header_len = 0;
+    bool keep_alive = false;
     int con_fd;
-    off_t f_size;
-    char page[PAGE_LENGTH], method[METHOD_LENGTH], http[HTTP_LENGTH];
+    str_ref page, method, http;         // references into connection's input buffer
+    const http_parser * parsed = NULL;  // header fields, NULL for malformed request
     std::string norm_path;
     time_t timestamp;
     char rem_ip[INET_ADDRSTRLEN];
 };
 
+/* Structure holds state of a client connection owned by the reactor */
+struct shard;
+
+struct connection {
+    struct shard * owner;   // shard whose reactor accepted it
+    int fd;
+    std::string in_buf;
+    http_parser parser;
+    char rem_ip[INET_ADDRSTRLEN];
+    uint32_t addr;          // remote IPv4 address in host order
+    bool busy = false;      // request is being served by a worker
+    int served = 0;         // number of requests answered on this connection
+    /* Start of the current wait: accept, previous response or first byte of a new header. Not moved by later bytes */
+    time_t waiting_since;
+};
+
+/* Version of a file's contents, the fields its ETag is made of, so a cached copy never outlives its ETag */
+struct file_version {
+    file_version() {}
+    explicit file_version(const struct stat & info)
+        : ino(info.st_ino), size(info.st_size), mtime(info.st_mtim) {}
+    bool operator==(const file_version & other) const {
+        return this->ino == other.ino && this->size == other.size
+               && this->mtime.tv_sec == other.mtime.tv_sec && this->mtime.tv_nsec == other.mtime.tv_nsec;
+    }
+    bool operator!=(const file_version & other) const { return !(*this == other); }
+    ino_t ino = 0;
+    off_t size = 0;
+    struct timespec mtime = {0, 0};
+};
+
+/* Cached file together with header fields describing it */
+struct cache_entry {
+    file_version version;
+    std::string header;     // Last-Modified, ETag, Content-Type and Content-Length lines
+    std::string body;
+};
+
 struct http_response {
-    unsigned int content_length = 0;
-    std::string header, content_type;
-    char * content = NULL;
+    off_t content_length = 0;   // length of the body actually sent
+    off_t range_start = 0;      // offset of the body in the file for 206
+    off_t file_size = 0;        // complete length reported in Content-Range
+    const char * content_type = NULL;
+    const char * cache_control = NULL;
+    int file_fd = -1;       // file is streamed by the worker when set
+    std::shared_ptr<const cache_entry> cached;
+    DIR * stream_dir = NULL;    // huge directory listed by the worker while sending
+    bool chunked = false;
     time_t mod_time = 0;
+    char etag[ETAG_MAX_LENGTH];
+    size_t etag_len = 0;
     int req_status;
+    bool keep_alive = false;
+    int retry_after = 0;    // seconds, sent with 429 and 503
+};
+
+/* Fixed-size text buffer reused by a thread for every response header or log line */
+template <size_t N>
+class fixed_buffer {
+public:
+    void clear() { this->len = 0; }
+    void append(const char * s, size_t n) {
+        /* Anything beyond the buffer is cut off */
+        n = std::min(n, N - this->len);
+        memcpy(this->buf + this->len, s, n);
+        this->len += n;
+    }
+    void append(const char * s) { this->append(s, strlen(s)); }
+    void append(const std::string & s) { this->append(s.data(), s.length()); }
+    void append_number(uint64_t n) {
+        char digits[20];
+        int i = sizeof(digits);
+        do {
+            digits[--i] = '0' + n % 10;
+            n /= 10;
+        } while (n);
+        this->append(digits + i, sizeof(digits) - i);
+    }
+    /* Ends text with a newline even if it was cut off */
+    void terminate_line() {
+        if (this->len == N) this->len--;
+        this->buf[this->len++] = '\n';
+    }
+    const char * data() const { return this->buf; }
+    size_t length() const { return this->len; }
+private:
+    char buf[N];
+    size_t len = 0;
 };
 
-/* Class for thread-safe logging */
+typedef fixed_buffer<HEADER_BUFFER_SIZE> header_builder;
+typedef fixed_buffer<LOG_LINE_MAX> log_line;
+
+/*
+ * Thread-safe LRU cache of file contents keyed by normalized path. Entries are
+ * validated against the file's version and evicted when byte budget is exceeded.
+ */
+class content_cache {
+public:
+    void set_capacity(size_t);
+    bool admits(off_t) const;
+    std::shared_ptr<const cache_entry> get(const std::string &, const file_version &);
+    void put(const std::string &, std::shared_ptr<const cache_entry>);
+    std::shared_ptr<const cache_entry> join_load(const std::string &, const file_version &, bool &);
+    void finish_load(const std::string &, std::shared_ptr<const cache_entry>);
+    cache_counters counters();
+    std::string stats();
+private:
+    /* File being read by one worker, others missing on the same version wait for it */
+    struct pending_load {
+        explicit pending_load(const file_version & version) : version(version) {}
+        file_version version;
+        bool done = false;
+        std::shared_ptr<const cache_entry> entry;   // NULL if loading failed
+    };
+    void evict(size_t);
+    void insert(const std::string &, std::shared_ptr<const cache_entry>);
+    typedef std::list<std::pair<std::string, std::shared_ptr<const cache_entry>>> lru_list;
+    std::mutex m;
+    lru_list lru;
+    std::unordered_map<std::string, lru_list::iterator> index;
+    std::unordered_map<std::string, std::shared_ptr<pending_load>> loading;
+    std::condition_variable loaded;     // every finished load wakes all waiters, each checks its own
+    size_t used = 0, capacity = 0;
+    uint64_t hits = 0, misses = 0, evictions = 0, coalesced = 0;
+};
+
+/* Single-producer single-consumer ring of log bytes */
+class log_ring {
+public:
+    explicit log_ring(size_t);
+    bool push(const char *, size_t);
+    size_t pop(char *, size_t);
+    size_t size() const;
+    size_t capacity() const { return this->mask + 1; }
+private:
+    char * buf;
+    size_t mask;
+    char pad0[64];
+    std::atomic<size_t> head;
+    char pad1[64];
+    std::atomic<size_t> tail;
+};
+
+/* Class for thread-safe asynchronous logging */
 class Log {
 public:
-    void execute(std::string);
-    void openlogfile(std::string);
+    void open(const std::string &, int);
+    bool enabled() const { return this->fd != -1; }
+    void append(int, const char *, size_t);
+    void close();
 private:
+    void writer();
+    void write_batch(const char *, size_t);
+    void request_flush();
+    int fd = -1;
+    std::vector<log_ring *> rings;
+    std::thread writer_thread;
     std::mutex m;
-    std::ofstream _logfile;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::atomic<bool> flush_requested{false};
+    std::atomic<uint64_t> dropped{0};
 };
 
-enum extension {
-    HTML,
-    JPEG,
-    UNKNOWN
+/*
+ * Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's design).
+ * Every cell carries a sequence number telling whether it is ready for a producer
+ * or a consumer, so push and pop only contend on a single CAS.
+ */
+template <typename T>
+class mpmc_queue {
+public:
+    explicit mpmc_queue(size_t capacity) {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        mask = size - 1;
+        cells = new cell[size];
+        for (size_t i=0; i<size; i++) cells[i].seq.store(i, std::memory_order_relaxed);
+        head.store(0, std::memory_order_relaxed);
+        tail.store(0, std::memory_order_relaxed);
+    }
+    ~mpmc_queue() { delete [] cells; }
+    bool push(const T & data) {
+        size_t pos = tail.load(std::memory_order_relaxed);
+        cell * c;
+        while (true) {
+            c = &cells[pos & mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) return false;        // full
+            else pos = tail.load(std::memory_order_relaxed);
+        }
+        c->data = data;
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+    bool pop(T & data) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        cell * c;
+        while (true) {
+            c = &cells[pos & mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            }
+            else if (diff < 0) return false;        // empty
+            else pos = head.load(std::memory_order_relaxed);
+        }
+        data = c->data;
+        c->seq.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+private:
+    struct cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+    cell * cells;
+    size_t mask;
+    /* Padding keeps producer and consumer indexes on separate cache lines */
+    char pad0[64];
+    std::atomic<size_t> head;
+    char pad1[64];
+    std::atomic<size_t> tail;
+};
+
+/* Per-client request budget, refilled lazily when the client sends a request */
+struct token_bucket {
+    double tokens;
+    uint64_t updated;       // monotonic ms
+};
+
+/*
+ * Token buckets of all clients, shared by the shards so a client gets the same
+ * rate however its connections are spread over them. Buckets are split into
+ * stripes by address, each with its own lock, so reactors rarely wait for each other
+ */
+class rate_limiter {
+public:
+    int take(uint32_t, uint64_t);
+    void prune(uint64_t);
+private:
+    struct alignas(64) stripe {
+        std::mutex m;
+        std::unordered_map<uint32_t, token_bucket> buckets;
+    };
+    stripe & stripe_of(uint32_t addr) { return this->stripes[(addr * 2654435761u) % RATE_LIMIT_STRIPES]; }
+    stripe stripes[RATE_LIMIT_STRIPES];
+};
+
+/*
+ * Shard is a listener with its own reactor, request queue and worker pool. With
+ * several shards every listener is bound with SO_REUSEPORT so the kernel spreads
+ * connections, and a connection stays on its shard for its whole life. Shards
+ * share only the content cache, the log and statistics.
+ */
+struct shard {
+    int id;
+    int cpu = -1;           // CPU the shard's threads are pinned to, -1 leaves them to the kernel
+    int socket_fd, epoll_fd, wakeup_fd, timer_fd;
+    std::vector<connection *> connections;      // by descriptor, NULL when it isn't a client
+    scheduler * sched;      // waiting requests, in order of the chosen policy
+    mpmc_queue<http_request *> * work_queue;
+    sem_t work_available;
+    std::atomic<int> ready_workers;
+    /* Pool size is changed by CAS, the reactor adds workers and idle workers retire themselves */
+    std::atomic<int> workers;
+    std::atomic<int> starting;  // started but not ready yet, no more are added meanwhile
+    std::atomic<int> running;   // threads not yet finished, retired ones included until they return
+    std::mutex pool_mutex;
+    std::vector<int> free_slots;    // worker indexes no running thread holds
+    int sched_workers;      // pool size the scheduler was last given, reactor only
+    uint64_t request_seq = 0;
+    std::mutex mutex_done;
+    std::vector<http_request *> completed, collected;   // swapped so both keep their capacity
+    /* Requests and connections are recycled by the reactor, it is the only thread creating and freeing them */
+    object_pool<http_request> request_pool;
+    object_pool<connection> connection_pool;
+};
+
+enum range_result {
+    RANGE_NONE,             // no usable Range, whole file is sent
+    RANGE_OK,
+    RANGE_UNSATISFIABLE
 };
 
 
@@ -107,22 +485,77 @@ void daemon_mode();
 void print_usage(const char *);
 void pr_error(const char *);
 void parse_args(int, char *);
-void create_socket_open_port();
-const std::string get_time_for_logging(time_t);
-const std::string get_time_in_gmt(time_t);
+int create_socket_open_port();
+size_t format_log_time(time_t, char *);
+void get_logstring(http_request *, http_response &, log_line &);
 const std::string get_ip(struct sockaddr_in *);
 void print_debugging_message();
-int get_method_as_int(const char *);
+int get_method_as_int(const str_ref &);
 const char * get_status_as_string(int);
-std::string normalize_path(char const *);
-void build_response_header(http_response &);
-void scheduling_thread();
-void worker_thread(int);
+int open_error_status(int);
+void normalize_path(const str_ref &, std::string &);
+str_ref request_path(const str_ref &);
+void build_response_header(http_response &, header_builder &);
+void append_entity_header(header_builder &, time_t, const str_ref &, const char *, const char *, off_t, bool);
+size_t format_etag(const struct stat &, char *);
+bool etag_matches(const str_ref &, const str_ref &);
+time_t parse_http_date(const str_ref &);
+bool not_modified(http_request *, http_response &);
+range_result parse_range(const str_ref &, off_t, off_t &, off_t &);
+void select_range(http_request *, http_response &);
+size_t format_http_date(time_t, char *);
+void refresh_date();
+const char * current_date();
+bool send_iov(int, struct iovec *, int);
+size_t parse_size(const std::string &);
+void handle_signals();
+void request_stop();
+bool wait_for_stop(int);
+void stop_workers(shard *);
+void set_nonblocking(int);
+bool send_all(int, const char *, size_t, int flags = 0);
+bool read_all(int, char *, size_t);
+bool send_file(int, int, off_t, size_t);
+bool send_file_buffered(int, int, off_t, size_t);
+shard * create_shard(int);
+void pin_thread(int);
+int worker_producer(shard *, int);
+int reactor_producer(shard *);
+void reactor_loop(shard *);
+void reactor_add(shard *, int, uint32_t);
+void accept_connections(shard *);
+void close_connection(connection *);
+void read_connection(connection *);
+bool wants_keep_alive(const http_parser &, int);
+void init_request(http_request *, connection *, size_t);
+void dispatch_request(connection *, size_t);
+void shed_request(http_request *, int, int);
+uint64_t monotonic_ms();
+void feed_workers(shard *);
+void complete_request(http_request *);
+void wake_reactor(shard *);
+void collect_completed(shard *);
+void close_idle_connections(shard *);
+void scheduling_thread(shard *);
+void worker_thread(shard *, int);
+bool wait_for_work(shard *);
+bool elastic_pool();
+bool spawn_worker(shard *);
+int64_t pool_wait(shard *);
+void grow_pool(shard *);
+int pool_timeout(shard *);
+bool retire_worker(shard *);
+bool claim_ready_worker(shard *);
 off_t get_filesize(std::string *);
-extension get_file_extension(const char *);
 void get_file_content(http_request *, http_response &);
-bool compare_time(http_request *, http_request *);
-bool compare_size(http_request *, http_request *);
+#ifdef SERVER_STATS
+void get_server_status(http_request *, http_response &);
+#endif
+void get_directory_listing(http_request *, struct stat &, http_response &);
+std::string listing_prologue(const std::string &);
+void append_html(std::string &, const char *);
+bool stream_listing(int, DIR *, const std::string &, bool);
+bool send_chunk(int, const char *, size_t, bool);
 
 
 #endif
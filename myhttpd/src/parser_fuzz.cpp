@@ -0,0 +1,216 @@
+#include "parser_fuzz.h"
+
+
+/* Seed inputs, mutated copies of them are fed to every function */
+static const char * const seeds[] = {
+    "GET /index.html HTTP/1.1\r\nHost: localhost:8080\r\nAccept: */*\r\nConnection: keep-alive\r\n\r\n",
+    "HEAD /pic.jpg?size=large HTTP/1.0\r\nIf-None-Match: W/\"5f3a-a1-64b0\", \"77\"\r\nRange: bytes=0-99\r\n\r\n",
+    "\r\nGET / HTTP/1.1\nHost: a\n\nGET /2 HTTP/1.1\r\n\r\n",
+    "GET /a/./b/../c/ HTTP/1.1\r\nIf-Range: Sat, 17 Oct 2026 12:00:00 GMT\r\n\r\n",
+    "bytes=0-499", "bytes=-200", "bytes=900-", "bytes=0-1,5-6", "bytes=99999999999999999999999-1",
+    "\"5f3a-a1-64b0\"", "W/\"a\", \"b\" ,*", "\"unterminated",
+    "/", "/a//b/./c/../d?x=/../", "/.hidden/x", "~/pic.jpg", "~/../..", "/dir/"
+};
+/* Bytes that matter to the parsers, a mutation inserts them more often than others */
+static const char tokens[] = "\r\n :/.-,\"W*~?\t=0123456789";
+
+static long parsed[3];      // results of whole-buffer parses, by parse_result
+
+
+/* Reports a broken invariant with the input that broke it and aborts, so sanitizers and libFuzzer stop there */
+void fuzz_check(bool ok, const char * what, const std::string & input) {
+    if (ok) return;
+    std::cerr << "FAIL " << what << "\ninput:";
+    for (unsigned char c : input) {
+        char hex[4];
+        snprintf(hex, sizeof(hex), " %02x", c);
+        std::cerr << hex;
+    }
+    std::cerr << "\n";
+    abort();
+}
+
+static bool inside(const str_ref & ref, const char * buf, size_t len) {
+    return ref.data >= buf && ref.data + ref.len <= buf + len;
+}
+
+/*
+ * Parses the input as a whole and again in segments ending at random offsets,
+ * copying the buffer before every call like a connection buffer that grows.
+ * Both must agree, and a parsed header must lie inside the buffer
+ */
+void fuzz_parser(const std::string & input, std::mt19937 & rng) {
+    http_parser whole;
+    parse_result res = whole.parse(input.data(), input.length());
+    parsed[res]++;
+    if (res == PARSE_DONE) {
+        size_t len = whole.length();
+        fuzz_check(len > 0 && len <= input.length() && input[len - 1] == '\n', "header length", input);
+        fuzz_check(whole.header_count >= 0 && whole.header_count <= PARSER_MAX_HEADERS, "header count", input);
+        fuzz_check(!whole.method.empty() && !whole.target.empty() && whole.version.len == 8, "request line", input);
+        fuzz_check(inside(whole.method, input.data(), len) && inside(whole.target, input.data(), len)
+                   && inside(whole.version, input.data(), len), "request line outside header", input);
+        for (int i = 0; i < whole.header_count; i++)
+            fuzz_check(!whole.headers[i].name.empty() && inside(whole.headers[i].name, input.data(), len)
+                       && inside(whole.headers[i].value, input.data(), len), "field outside header", input);
+    }
+    http_parser split;
+    parse_result split_res = PARSE_INCOMPLETE;
+    std::string buf;
+    size_t end = 0;
+    while (split_res == PARSE_INCOMPLETE && end < input.length()) {
+        end = std::min(input.length(), end + 1 + rng() % 64);
+        std::string grown = input.substr(0, end);
+        buf.swap(grown);
+        split_res = split.parse(buf.data(), buf.length());
+    }
+    if (input.empty()) split_res = split.parse(buf.data(), 0);
+    fuzz_check(split_res == res, "split result differs", input);
+    if (res != PARSE_DONE) return;
+    fuzz_check(split.length() == whole.length() && split.header_count == whole.header_count, "split header differs", input);
+    fuzz_check(split.method.str() == whole.method.str() && split.target.str() == whole.target.str()
+               && split.version.str() == whole.version.str(), "split request line differs", input);
+    for (int i = 0; i < whole.header_count; i++)
+        fuzz_check(split.headers[i].name.str() == whole.headers[i].name.str()
+                   && split.headers[i].value.str() == whole.headers[i].value.str(), "split field differs", input);
+}
+
+/* Range that is served must lie inside the file */
+void fuzz_range(const std::string & input) {
+    static const off_t sizes[] = {0, 1, 1000, std::numeric_limits<off_t>::max()};
+    for (const std::string & spec : {input, "bytes=" + input}) {
+        for (off_t size : sizes) {
+            off_t start = -1, length = -1;
+            range_result res = parse_range(str_ref(spec.data(), spec.length()), size, start, length);
+            if (res == RANGE_OK)
+                fuzz_check(start >= 0 && length > 0 && length <= size - start, "range outside file", spec);
+        }
+    }
+}
+
+/* Any list is scanned without overrunning it, a tag always matches itself */
+void fuzz_etag(const std::string & input) {
+    std::string etag = "\"";
+    for (char c : input) if (c != '"') etag.push_back(c);
+    etag.push_back('"');
+    str_ref tag(etag.data(), etag.length());
+    etag_matches(str_ref(input.data(), input.length()), tag);
+    fuzz_check(etag_matches(tag, tag), "tag doesn't match itself", input);
+    std::string weak = "\"x\", W/" + etag;
+    fuzz_check(etag_matches(str_ref(weak.data(), weak.length()), tag), "weak tag in list doesn't match", input);
+}
+
+/*
+ * Normalized path stays under its root, keeps no dot segments, query or
+ * empty segments, and normalizing it again changes nothing
+ */
+void fuzz_path(const std::string & input) {
+    home_root = "/home/fuzz/myhttpd";
+    std::string out;
+    normalize_path(str_ref(input.data(), input.length()), out);
+    if (out.empty()) return;
+    bool home = out.compare(0, home_root.length() + 1, home_root + "/") == 0;
+    fuzz_check(home || out.compare(0, 2, "./") == 0, "path outside root", input);
+    size_t root_len = home ? home_root.length() : 1;
+    fuzz_check(out.find("/.", root_len) == std::string::npos, "dot segment left", input);
+    fuzz_check(out.find("//", root_len) == std::string::npos, "empty segment left", input);
+    fuzz_check(out.find('?') == std::string::npos, "query left", input);
+    std::string again = (home ? "~" : "") + out.substr(root_len), renormalized;
+    normalize_path(str_ref(again.data(), again.length()), renormalized);
+    fuzz_check(renormalized == out, "normalizing twice changes path", input);
+}
+
+std::string mutate(const std::string & seed, std::mt19937 & rng) {
+    std::string out = seed;
+    int count = 1 + rng() % FZ_MAX_MUTATIONS;
+    for (int i = 0; i < count; i++) {
+        size_t pos = out.empty() ? 0 : rng() % (out.length() + 1);
+        char c = rng() % 2 ? tokens[rng() % (sizeof(tokens) - 1)] : (char)(rng() % 256);
+        switch (rng() % 5) {
+            case 0:
+            out.insert(pos, 1, c);
+            break;
+            case 1:
+            if (pos < out.length()) out[pos] = c;
+            break;
+            case 2:
+            if (pos < out.length()) out.erase(pos, 1 + rng() % 8);
+            break;
+            case 3:
+            /* Repeated span makes long lines and many header fields */
+            if (pos < out.length()) {
+                std::string span = out.substr(pos, 1 + rng() % 32);
+                for (int n = rng() % 64; n > 0; n--) out.insert(pos, span);
+            }
+            break;
+            default:
+            out.insert(pos, seeds[rng() % (sizeof(seeds) / sizeof(seeds[0]))]);
+        }
+        if (out.length() > FZ_MAX_INPUT) out.resize(FZ_MAX_INPUT);
+    }
+    return out;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size) {
+    std::string input((const char *)data, size);
+    /* Split points depend on the input only, so a crash reproduces from it */
+    std::seed_seq seq(input.begin(), input.end());
+    std::mt19937 rng(seq);
+    fuzz_parser(input, rng);
+    fuzz_range(input);
+    fuzz_etag(input);
+    fuzz_path(input);
+    return 0;
+}
+
+#ifndef PARSER_FUZZ_LIBFUZZER
+void print_fuzz_usage(const char * exec) {
+    std::cout   << "\nUSAGE: " << exec << " [Options]\n\n"
+                << "Feeds mutated requests, ranges, entity tags and paths to the request parsers\n"
+                << "and checks their invariants. Aborts with the offending input on the first\n"
+                << "failure, otherwise prints one JSON line with counts of parse results.\n\n"
+                << "Options:\n" << "\t-h\t\tPrint a usage summary;\n"
+                << "\t-i <count>\tNumber of inputs. Default: 100000;\n"
+                << "\t-s <seed>\tSeed of the mutations, same seed gives same inputs. Default: 1;\n\n";
+    exit(0);
+}
+
+void parse_fuzz_args(int ac, char * av[]) {
+    const char * exec_name = av[0];
+    try {
+        for(int i=1; i<ac; i++) {
+            std::string current = av[i];
+            if (current.size() != 2 || current[0] != '-') print_fuzz_usage(exec_name);
+            switch (current[1]) {
+                case 'i':
+                if (++i >= ac) print_fuzz_usage(exec_name);
+                fz_params.iterations = std::stol(av[i]);
+                break;
+                case 's':
+                if (++i >= ac) print_fuzz_usage(exec_name);
+                fz_params.seed = std::stoul(av[i]);
+                break;
+                default:
+                print_fuzz_usage(exec_name);
+            }
+        }
+    }
+    catch (const std::exception &) {
+        print_fuzz_usage(exec_name);
+    }
+    if (fz_params.iterations < 0) print_fuzz_usage(exec_name);
+}
+
+int main(int argc, char * argv[]) {
+    parse_fuzz_args(argc, argv);
+    std::mt19937 rng(fz_params.seed);
+    for (const char * seed : seeds) LLVMFuzzerTestOneInput((const uint8_t *)seed, strlen(seed));
+    for (long i = 0; i < fz_params.iterations; i++) {
+        std::string input = mutate(seeds[rng() % (sizeof(seeds) / sizeof(seeds[0]))], rng);
+        LLVMFuzzerTestOneInput((const uint8_t *)input.data(), input.length());
+    }
+    printf("{\"iterations\":%ld,\"seed\":%u,\"done\":%ld,\"incomplete\":%ld,\"error\":%ld}\n", fz_params.iterations,
+           fz_params.seed, parsed[PARSE_DONE], parsed[PARSE_INCOMPLETE], parsed[PARSE_ERROR]);
+    return 0;
+}
+#endif
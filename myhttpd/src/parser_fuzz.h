@@ -0,0 +1,44 @@
+#ifndef PARSER_FUZZ_H
+#define PARSER_FUZZ_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <limits>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include "myhttpd.h"
+
+/* Defaults of the fuzzer */
+#define FZ_DEFAULT_ITERATIONS               100000
+#define FZ_DEFAULT_SEED                     1
+/* Mutations applied to a seed input, at most */
+#define FZ_MAX_MUTATIONS                    8
+/* Inputs grow up to a bit over the parser's buffer limit */
+#define FZ_MAX_INPUT                        (HEADER_MAX_LENGTH + 256)
+
+/* Structure holds parameters of a run */
+static struct fz_parameters {
+    long iterations = FZ_DEFAULT_ITERATIONS;
+    unsigned seed = FZ_DEFAULT_SEED;
+} fz_params;
+
+/* Directory "~" stands for, normalize_path() reads it */
+extern std::string home_root;
+
+/* Built with -DPARSER_FUZZ_LIBFUZZER and -fsanitize=fuzzer libFuzzer drives the same checks */
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *, size_t);
+
+void print_fuzz_usage(const char *);
+void parse_fuzz_args(int, char *[]);
+void fuzz_check(bool, const char *, const std::string &);
+void fuzz_parser(const std::string &, std::mt19937 &);
+void fuzz_range(const std::string &);
+void fuzz_etag(const std::string &);
+void fuzz_path(const std::string &);
+std::string mutate(const std::string &, std::mt19937 &);
+
+#endif
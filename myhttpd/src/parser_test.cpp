@@ -0,0 +1,204 @@
+#include "parser_test.h"
+
+
+static int passed = 0, failed = 0;
+
+static std::string too_many_headers() {
+    std::string req = "GET / HTTP/1.1\r\n";
+    for (int i = 0; i <= PARSER_MAX_HEADERS; i++) req += "X-Header: " + std::to_string(i) + "\r\n";
+    return req + "\r\n";
+}
+static const std::string many_headers = too_many_headers();
+
+static const request_case requests[] = {
+    {"get", "GET /index.html HTTP/1.1\r\nHost: localhost:8080\r\nAccept: */*\r\n\r\n",
+     PARSE_DONE, 0, "GET", "/index.html", "HTTP/1.1", 2, "localhost:8080"},
+    {"head-query", "HEAD /pic.jpg?size=large HTTP/1.0\r\n\r\n",
+     PARSE_DONE, 0, "HEAD", "/pic.jpg?size=large", "HTTP/1.0", 0, NULL},
+    {"bare-lf", "GET / HTTP/1.1\nHost: a\n\n",
+     PARSE_DONE, 0, "GET", "/", "HTTP/1.1", 1, "a"},
+    {"leading-empty-lines", "\r\n\r\nGET / HTTP/1.1\r\nHost: a\r\n\r\n",
+     PARSE_DONE, 0, "GET", "/", "HTTP/1.1", 1, "a"},
+    {"trimmed-value", "GET / HTTP/1.1\r\nhOsT: \t spaced value \t\r\n\r\n",
+     PARSE_DONE, 0, "GET", "/", "HTTP/1.1", 1, "spaced value"},
+    {"empty-value", "GET / HTTP/1.1\r\nHost:\r\n\r\n",
+     PARSE_DONE, 0, "GET", "/", "HTTP/1.1", 1, ""},
+    {"pipelined", "GET /1 HTTP/1.1\r\nHost: a\r\n\r\nGET /2 HTTP/1.1\r\nHost: b\r\n\r\n",
+     PARSE_DONE, 28, "GET", "/1", "HTTP/1.1", 1, "a"},
+    {"unknown-method", "BREW /pot HTTP/1.1\r\n\r\n",
+     PARSE_DONE, 0, "BREW", "/pot", "HTTP/1.1", 0, NULL},
+    {"no-empty-line", "GET / HTTP/1.1\r\nHost: a\r\n",
+     PARSE_INCOMPLETE, 0, NULL, NULL, NULL, 0, NULL},
+    {"no-version", "GET /\r\n\r\n", PARSE_ERROR, 0, NULL, NULL, NULL, 0, NULL},
+    {"long-version", "GET / HTTP/1.10\r\n\r\n", PARSE_ERROR, 0, NULL, NULL, NULL, 0, NULL},
+    {"lowercase-version", "GET / http/1.1\r\n\r\n", PARSE_ERROR, 0, NULL, NULL, NULL, 0, NULL},
+    {"double-space", "GET  / HTTP/1.1\r\n\r\n", PARSE_ERROR, 0, NULL, NULL, NULL, 0, NULL},
+    {"method-separator", "G(T / HTTP/1.1\r\n\r\n", PARSE_ERROR, 0, NULL, NULL, NULL, 0, NULL},
+    {"target-control", "GET /a\x01 HTTP/1.1\r\n\r\n", PARSE_ERROR, 0, NULL, NULL, NULL, 0, NULL},
+    {"no-colon", "GET / HTTP/1.1\r\nHost localhost\r\n\r\n", PARSE_ERROR, 0, NULL, NULL, NULL, 0, NULL},
+    {"empty-name", "GET / HTTP/1.1\r\n: value\r\n\r\n", PARSE_ERROR, 0, NULL, NULL, NULL, 0, NULL},
+    {"space-before-colon", "GET / HTTP/1.1\r\nHost : a\r\n\r\n", PARSE_ERROR, 0, NULL, NULL, NULL, 0, NULL},
+    {"folded-line", "GET / HTTP/1.1\r\nHost: a\r\n b\r\n\r\n", PARSE_ERROR, 0, NULL, NULL, NULL, 0, NULL},
+    {"too-many-headers", many_headers.c_str(), PARSE_ERROR, 0, NULL, NULL, NULL, 0, NULL}
+};
+
+static const range_case ranges[] = {
+    {"bytes=0-499", 1000, RANGE_OK, 0, 500},
+    {"bytes=500-", 1000, RANGE_OK, 500, 500},
+    {"bytes=-200", 1000, RANGE_OK, 800, 200},
+    {"bytes=-2000", 1000, RANGE_OK, 0, 1000},
+    {"bytes=900-5000", 1000, RANGE_OK, 900, 100},
+    {"BYTES=0-0", 1000, RANGE_OK, 0, 1},
+    {"bytes=99999999999999999999999-", 1000, RANGE_UNSATISFIABLE, 0, 0},
+    {"bytes=1000-", 1000, RANGE_UNSATISFIABLE, 0, 0},
+    {"bytes=-0", 1000, RANGE_UNSATISFIABLE, 0, 0},
+    {"bytes=-5", 0, RANGE_UNSATISFIABLE, 0, 0},
+    {"bytes=5-1", 1000, RANGE_NONE, 0, 0},
+    {"bytes=0-1,5-6", 1000, RANGE_NONE, 0, 0},
+    {"bytes=-", 1000, RANGE_NONE, 0, 0},
+    {"bytes=1-2x", 1000, RANGE_NONE, 0, 0},
+    {"items=0-1", 1000, RANGE_NONE, 0, 0},
+    {"", 1000, RANGE_NONE, 0, 0}
+};
+
+static const etag_case etags[] = {
+    {"\"a1\"", "\"a1\"", true},
+    {"W/\"a1\"", "\"a1\"", true},
+    {"\"b2\", \"a1\"", "\"a1\"", true},
+    {" ,\t\"a1\"", "\"a1\"", true},
+    {"*", "\"a1\"", true},
+    {"\"a12\"", "\"a1\"", false},
+    {"\"a1", "\"a1\"", false},
+    {"a1", "\"a1\"", false},
+    {"W/", "\"a1\"", false},
+    {"", "\"a1\"", false}
+};
+
+static const path_case paths[] = {
+    {"/", "", "./"},
+    {"/index.html", "", "./index.html"},
+    {"/a/./b/../c", "", "./a/c"},
+    {"/a//b", "", "./a/b"},
+    {"/dir/", "", "./dir/"},
+    {"/a/..", "", "./"},
+    {"/x?y=/../../", "", "./x"},
+    {"/..", "", ""},
+    {"/a/../..", "", ""},
+    {"/.git/config", "", ""},
+    {"/a/.hidden/", "", ""},
+    {"relative", "", ""},
+    {"", "", ""},
+    {"~/pic.jpg", "/home/user/myhttpd", "/home/user/myhttpd/pic.jpg"},
+    {"~/..", "/home/user/myhttpd", ""},
+    {"~/pic.jpg", "", ""}
+};
+
+
+void fail(const std::string & name, const std::string & why) {
+    std::cout << "FAIL " << name << ": " << why << "\n";
+    failed++;
+}
+
+/* Compares what parser found with the case. Buffer is where parser's references point to */
+bool check_request(const request_case & c, const char * buf, const http_parser & parser, parse_result res) {
+    std::string name = std::string("request/") + c.name;
+    if (res != c.result) {
+        fail(name, "result " + std::to_string(res) + ", expected " + std::to_string(c.result));
+        return false;
+    }
+    if (res != PARSE_DONE) return true;
+    size_t length = c.length ? c.length : strlen(c.input);
+    if (parser.length() != length) {
+        fail(name, "length " + std::to_string(parser.length()) + ", expected " + std::to_string(length));
+        return false;
+    }
+    if (!parser.method.equals(c.method) || !parser.target.equals(c.target) || !parser.version.equals(c.version)) {
+        fail(name, "request line \"" + parser.method.str() + " " + parser.target.str() + " " + parser.version.str() + "\"");
+        return false;
+    }
+    if (parser.header_count != c.headers) {
+        fail(name, std::to_string(parser.header_count) + " header fields, expected " + std::to_string(c.headers));
+        return false;
+    }
+    str_ref host = parser.header("Host");
+    if (c.host ? !host.data || !host.equals(c.host) : host.data != NULL) {
+        fail(name, "Host \"" + host.str() + "\"");
+        return false;
+    }
+    /* References must point into the caller's buffer, not to an earlier copy */
+    if (parser.method.data < buf || parser.version.data + parser.version.len > buf + length) {
+        fail(name, "request line doesn't point into the buffer");
+        return false;
+    }
+    return true;
+}
+
+void test_whole_request(const request_case & c) {
+    http_parser parser;
+    std::string buf(c.input);
+    if (check_request(c, buf.data(), parser, parser.parse(buf.data(), buf.length()))) passed++;
+}
+
+/*
+ * Input arrives in two segments split at every offset, then one byte at a time.
+ * Buffer is copied before every call like a growing connection buffer that
+ * may be reallocated, the result must not depend on where segments end
+ */
+void test_split_request(const request_case & c) {
+    std::string input(c.input);
+    for (size_t split = 0; split <= input.length(); split++) {
+        http_parser parser;
+        std::string first = input.substr(0, split);
+        parse_result res = parser.parse(first.data(), first.length());
+        if (res == PARSE_INCOMPLETE) {
+            std::string whole = input;
+            res = parser.parse(whole.data(), whole.length());
+            if (!check_request(c, whole.data(), parser, res)) return;
+        }
+        /* Everything up to the end of a complete header is enough, less is never */
+        else if (!check_request(c, first.data(), parser, res)) return;
+    }
+    http_parser parser;
+    std::string buf;
+    parse_result res = PARSE_INCOMPLETE;
+    for (size_t i = 0; i < input.length() && res == PARSE_INCOMPLETE; i++) {
+        std::string grown = buf + input[i];
+        buf.swap(grown);
+        res = parser.parse(buf.data(), buf.length());
+    }
+    if (check_request(c, buf.data(), parser, res)) passed++;
+}
+
+void test_range(const range_case & c) {
+    off_t start = -1, length = -1;
+    range_result res = parse_range(str_ref(c.spec, strlen(c.spec)), c.size, start, length);
+    std::string name = std::string("range/") + c.spec + "/" + std::to_string(c.size);
+    if (res != c.result) fail(name, "result " + std::to_string(res) + ", expected " + std::to_string(c.result));
+    else if (res == RANGE_OK && (start != c.start || length != c.length))
+        fail(name, "range " + std::to_string(start) + "+" + std::to_string(length));
+    else passed++;
+}
+
+void test_etag(const etag_case & c) {
+    bool res = etag_matches(str_ref(c.list, strlen(c.list)), str_ref(c.etag, strlen(c.etag)));
+    if (res != c.matches) fail(std::string("etag/") + c.list, res ? "matches" : "doesn't match");
+    else passed++;
+}
+
+void test_path(const path_case & c) {
+    std::string out = "garbage";
+    home_root = c.home;
+    normalize_path(str_ref(c.page, strlen(c.page)), out);
+    if (out != c.normalized) fail(std::string("path/") + c.page, "\"" + out + "\", expected \"" + c.normalized + "\"");
+    else passed++;
+}
+
+int main() {
+    for (const request_case & c : requests) test_whole_request(c);
+    for (const request_case & c : requests) test_split_request(c);
+    for (const range_case & c : ranges) test_range(c);
+    for (const etag_case & c : etags) test_etag(c);
+    for (const path_case & c : paths) test_path(c);
+    std::cout << passed << " passed, " << failed << " failed\n";
+    return failed ? 1 : 0;
+}
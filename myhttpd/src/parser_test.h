@@ -0,0 +1,50 @@
+#ifndef PARSER_TEST_H
+#define PARSER_TEST_H
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include "myhttpd.h"
+
+/* Directory "~" stands for, normalize_path() reads it */
+extern std::string home_root;
+
+/* Request header with the parse result and fields it must produce */
+struct request_case {
+    const char * name;
+    const char * input;
+    parse_result result;
+    size_t length;          // header length when result is PARSE_DONE, 0 means the whole input
+    const char * method, * target, * version;
+    int headers;
+    const char * host;      // value of Host, NULL if request has none
+};
+
+struct range_case {
+    const char * spec;
+    off_t size;
+    range_result result;
+    off_t start, length;    // checked only when result is RANGE_OK
+};
+
+struct etag_case {
+    const char * list;
+    const char * etag;
+    bool matches;
+};
+
+struct path_case {
+    const char * page;
+    const char * home;      // home_root while normalizing
+    const char * normalized;
+};
+
+bool check_request(const request_case &, const char *, const http_parser &, parse_result);
+void test_whole_request(const request_case &);
+void test_split_request(const request_case &);
+void test_range(const range_case &);
+void test_etag(const etag_case &);
+void test_path(const path_case &);
+void fail(const std::string &, const std::string &);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <memory>
+#include <vector>
+
+/* Idle objects kept by a pool, anything released beyond that is freed */
+#define POOL_DEFAULT_LIMIT                  4096
+
+/*
+ * Free list of objects used by a single thread. A released object isn't
+ * destroyed, so its strings and vectors keep the capacity they grew to and a
+ * recycled object costs no allocation. Caller re-initializes what it takes.
+ *
+ * Ownership outside of the shard's queues is held by a handle, which gives
+ * the object back to its pool when it goes out of scope.
+ */
+template <typename T>
+class object_pool {
+public:
+    struct deleter {
+        object_pool * pool;
+        void operator()(T * obj) const { pool->release(obj); }
+    };
+    typedef std::unique_ptr<T, deleter> handle;
+
+    explicit object_pool(size_t limit = POOL_DEFAULT_LIMIT) : limit(limit) {}
+    ~object_pool() { for (T * obj : this->idle) delete obj; }
+    object_pool(const object_pool &) = delete;
+    object_pool & operator=(const object_pool &) = delete;
+
+    handle acquire() {
+        if (this->idle.empty()) return this->adopt(new T());
+        T * obj = this->idle.back();
+        this->idle.pop_back();
+        return this->adopt(obj);
+    }
+    /* Takes back ownership of an object that was released from its handle */
+    handle adopt(T * obj) { return handle(obj, deleter{this}); }
+private:
+    void release(T * obj) {
+        if (this->idle.size() < this->limit) this->idle.push_back(obj);
+        else delete obj;
+    }
+
+    std::vector<T *> idle;
+    size_t limit;
+};
+
+#endif
@@ -0,0 +1,176 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <arpa/inet.h>
+
+/* Heap keeps the smallest key on top, arrival order decides between equal keys */
+static bool runs_later(const sched_job * a, const sched_job * b) {
+    if (a->key != b->key) return a->key > b->key;
+    return a->seq > b->seq;
+}
+
+void heap_scheduler::push(sched_job * job) {
+    job->key = this->key(job);
+    this->heap.push_back(job);
+    std::push_heap(this->heap.begin(), this->heap.end(), runs_later);
+}
+
+void heap_scheduler::pop() {
+    std::pop_heap(this->heap.begin(), this->heap.end(), runs_later);
+    this->heap.pop_back();
+}
+
+double edf_scheduler::key(sched_job * job) {
+    job->deadline = job->arrived + (uint64_t)(this->slack + job->size / this->rate);
+    return job->deadline;
+}
+
+split_scheduler::split_scheduler(off_t threshold, int workers, int reserve)
+    : threshold(threshold), reserve(reserve) {
+    this->resize(workers);
+}
+
+/* Large requests already running above a smaller share finish, no more start until they fit it */
+void split_scheduler::resize(int workers) {
+    this->large_max = std::max(1, workers - this->reserve);
+}
+
+void split_scheduler::push(sched_job * job) {
+    job->large = job->size > this->threshold;
+    (job->large ? this->large : this->small).push_back(job);
+}
+
+sched_job * split_scheduler::next() {
+    bool large_ok = !this->large.empty() && this->large_busy < this->large_max;
+    if (this->small.empty() && !large_ok) return NULL;
+    this->next_large = large_ok && (this->small.empty() || this->large.front()->seq < this->small.front()->seq);
+    return this->next_large ? this->large.front() : this->small.front();
+}
+
+void split_scheduler::pop() {
+    if (this->next_large) {
+        this->large.pop_front();
+        this->large_busy++;
+    }
+    else this->small.pop_front();
+}
+
+void split_scheduler::done(sched_job * job) {
+    if (job->large) this->large_busy--;
+}
+
+/* Large request held back over its share is still next in line */
+sched_job * split_scheduler::head() {
+    sched_job * job = this->next();
+    if (!job && !this->large.empty()) job = this->large.front();
+    return job;
+}
+
+void fair_scheduler::push(sched_job * job) {
+    auto it = this->flows.find(job->client);
+    if (it == this->flows.end()) {
+        /* Idle clients are dropped in bulk so a steady set of clients never reallocates */
+        if (this->flows.size() - this->active >= SCHED_FAIR_MAX_IDLE) {
+            for (auto f = this->flows.begin(); f != this->flows.end(); ) {
+                if (!f->second.first) f = this->flows.erase(f);
+                else ++f;
+            }
+        }
+        it = this->flows.emplace(job->client, flow()).first;
+        it->second.weight = this->weight_of(job->client);
+    }
+    flow * f = &it->second;
+    job->next_in_flow = NULL;
+    this->waiting++;
+    if (f->first) {
+        f->last->next_in_flow = job;
+        f->last = job;
+        return;
+    }
+    f->first = f->last = job;
+    this->active++;
+    this->append(f);
+}
+
+/* Takes the head client's request and passes the turn on when it has used it up */
+void fair_scheduler::pop() {
+    flow * f = this->head;
+    f->first = f->first->next_in_flow;
+    this->waiting--;
+    f->credit--;
+    if (!f->first || !f->credit) {
+        this->head = f->next;
+        if (!this->head) this->tail = NULL;
+        f->next = NULL;
+        if (!f->first) this->active--;
+        else this->append(f);
+    }
+}
+
+/* Puts client at the end of the round with a fresh turn */
+void fair_scheduler::append(flow * f) {
+    f->credit = f->weight;
+    if (this->tail) this->tail->next = f;
+    else this->head = f;
+    this->tail = f;
+}
+
+int fair_scheduler::weight_of(uint32_t client) const {
+    const subnet_weight * best = NULL;
+    for (const subnet_weight & w : this->weights)
+        if ((client & w.mask) == w.net && (!best || w.mask > best->mask)) best = &w;
+    return best ? best->weight : 1;
+}
+
+/* Creates policy by its name, NULL if there is no such policy. Workers is the pool served by it */
+scheduler * make_scheduler(const std::string & policy, const sched_params & params, int workers) {
+    if (policy == "FCFS") return new fcfs_scheduler();
+    if (policy == "SJF") return new sjf_scheduler();
+    if (policy == "SRPT") return new srpt_scheduler(params.srpt_aging);
+    if (policy == "EDF") return new edf_scheduler(params.edf_slack, params.edf_rate);
+    if (policy == "SPLIT") return new split_scheduler(params.split_threshold, workers, params.split_reserve);
+    if (policy == "FAIR") return new fair_scheduler(params.weights);
+    return NULL;
+}
+
+/* Sets a tunable from "name=value". Returns false for unknown name or bad value */
+bool sched_set_option(sched_params & params, const std::string & option) {
+    size_t eq = option.find('=');
+    if (eq == std::string::npos) return false;
+    std::string name = option.substr(0, eq);
+    const char * value = option.c_str() + eq + 1;
+    char * end;
+    double v = strtod(value, &end);
+    if (end == value || *end || v < 0) return false;
+    if (name == "srpt.aging") params.srpt_aging = v;
+    else if (name == "edf.slack") params.edf_slack = v;
+    else if (name == "edf.rate" && v > 0) params.edf_rate = v;
+    else if (name == "split.threshold") params.split_threshold = v;
+    else if (name == "split.reserve") params.split_reserve = v;
+    else return false;
+    return true;
+}
+
+/* Adds weight of a subnet from "address[/bits]=weight" */
+bool sched_add_weight(sched_params & params, const std::string & option) {
+    size_t eq = option.find('='), slash = option.find('/');
+    if (eq == std::string::npos || (slash != std::string::npos && slash > eq)) return false;
+    std::string address = option.substr(0, std::min(slash, eq));
+    struct in_addr addr;
+    if (inet_pton(AF_INET, address.c_str(), &addr) != 1) return false;
+    char * end;
+    long bits = 32;
+    if (slash != std::string::npos) {
+        bits = strtol(option.c_str() + slash + 1, &end, 10);
+        if (end != option.c_str() + eq || bits < 0 || bits > 32) return false;
+    }
+    long weight = strtol(option.c_str() + eq + 1, &end, 10);
+    if (end == option.c_str() + eq + 1 || *end || weight < 1) return false;
+    subnet_weight w;
+    w.mask = bits ? ~0u << (32 - bits) : 0;
+    w.net = ntohl(addr.s_addr) & w.mask;
+    w.weight = weight;
+    params.weights.push_back(w);
+    return true;
+}
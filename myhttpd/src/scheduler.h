@@ -0,0 +1,176 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/types.h>
+
+/* Tunables of the policies, set with -o name=value */
+#define SCHED_DEFAULT_SRPT_AGING            64          // bytes a waiting request gains per ms
+#define SCHED_DEFAULT_EDF_SLACK             50          // ms every request may take regardless of size
+#define SCHED_DEFAULT_EDF_RATE              100000      // bytes per ms a worker is expected to send
+#define SCHED_DEFAULT_SPLIT_THRESHOLD       (64 << 10)  // bytes, bigger requests are large
+#define SCHED_DEFAULT_SPLIT_RESERVE         1           // workers large requests may never take
+/* FAIR forgets clients with nothing queued once it tracks more than this */
+#define SCHED_FAIR_MAX_IDLE                 4096
+
+/*
+ * What a policy knows about a request. Server requests and simulated ones
+ * derive from it, schedulers only keep pointers and never free them.
+ */
+struct sched_job {
+    uint64_t seq;           // arrival order, ties are broken by it so every order is strict
+    uint64_t arrived;       // monotonic ms
+    off_t size;             // bytes to send, estimated before the request is served
+    uint64_t deadline;      // ms, set by EDF
+    double key;             // priority of heap-based policies, smaller runs first
+    bool large;             // counted against the large share by the two-class policy
+    uint32_t client;        // IPv4 address in host order, FAIR queues by it
+    sched_job * next_in_flow;   // FAIR links a client's requests through it
+};
+
+/* Clients of a subnet get weight turns of their own for every turn of a default client */
+struct subnet_weight {
+    uint32_t net, mask;
+    int weight;
+};
+
+struct sched_params {
+    double srpt_aging = SCHED_DEFAULT_SRPT_AGING;
+    double edf_slack = SCHED_DEFAULT_EDF_SLACK;
+    double edf_rate = SCHED_DEFAULT_EDF_RATE;
+    off_t split_threshold = SCHED_DEFAULT_SPLIT_THRESHOLD;
+    int split_reserve = SCHED_DEFAULT_SPLIT_RESERVE;
+    std::vector<subnet_weight> weights;     // most specific subnet wins
+};
+
+/*
+ * Order in which waiting requests are handed to workers. A scheduler is used
+ * by one thread. next() returns the request that should run now, or NULL if
+ * none may, and keeps returning it until pop() or push(). done() is called when
+ * a request that was popped has been served. head() is the request next in
+ * line even if the policy holds it back, resize() tells it how many workers there are.
+ */
+class scheduler {
+public:
+    virtual ~scheduler() {}
+    virtual void push(sched_job *) = 0;
+    virtual sched_job * next() = 0;
+    virtual void pop() = 0;
+    virtual void done(sched_job *) {}
+    virtual sched_job * head() { return this->next(); }
+    virtual void resize(int) {}
+    virtual size_t size() const = 0;
+    bool empty() const { return !this->size(); }
+};
+
+/* Binary heap over a key computed once on push, so push and pop are O(log n) */
+class heap_scheduler : public scheduler {
+public:
+    void push(sched_job *);
+    sched_job * next() { return this->heap.empty() ? NULL : this->heap.front(); }
+    void pop();
+    size_t size() const { return this->heap.size(); }
+protected:
+    virtual double key(sched_job *) = 0;
+private:
+    std::vector<sched_job *> heap;
+};
+
+/* Order of arrival */
+class fcfs_scheduler : public heap_scheduler {
+protected:
+    double key(sched_job *) { return 0; }
+};
+
+/* Smallest request first, large ones wait as long as smaller keep coming */
+class sjf_scheduler : public heap_scheduler {
+protected:
+    double key(sched_job * job) { return job->size; }
+};
+
+/*
+ * Smallest remaining bytes first, with aging: every ms of waiting takes aging
+ * bytes off a request's size. All requests age at the same rate so the order
+ * never changes after push and the key is size + aging * arrival time.
+ * Requests aren't preempted, remaining bytes are the whole response.
+ */
+class srpt_scheduler : public heap_scheduler {
+public:
+    explicit srpt_scheduler(double aging) : aging(aging) {}
+protected:
+    double key(sched_job * job) { return job->size + this->aging * job->arrived; }
+private:
+    double aging;
+};
+
+/* Earliest deadline first. Deadline is arrival + slack + expected time to send the response */
+class edf_scheduler : public heap_scheduler {
+public:
+    edf_scheduler(double slack, double rate) : slack(slack), rate(rate) {}
+protected:
+    double key(sched_job *);
+private:
+    double slack, rate;
+};
+
+/*
+ * Small and large requests wait in separate FIFOs, the older head runs first.
+ * Large ones may take at most workers - reserve workers at a time, so small
+ * requests always find a worker that isn't stuck with a big file. Share follows
+ * the number of workers as the pool grows and shrinks. O(1)
+ */
+class split_scheduler : public scheduler {
+public:
+    split_scheduler(off_t threshold, int workers, int reserve);
+    void push(sched_job *);
+    sched_job * next();
+    void pop();
+    void done(sched_job *);
+    sched_job * head();
+    void resize(int);
+    size_t size() const { return this->small.size() + this->large.size(); }
+private:
+    std::deque<sched_job *> small, large;
+    off_t threshold;
+    int reserve, large_max, large_busy = 0;
+    bool next_large = false;
+};
+
+/*
+ * Deficit round robin over clients. Every client has its own FIFO and clients
+ * with requests waiting take turns, each turn runs as many requests as the
+ * client's weight. A client with hundreds of connections gets the same share
+ * of workers as one with a single connection. Cost is counted in requests, not
+ * bytes, so no turn ever loops and every operation is O(1)
+ */
+class fair_scheduler : public scheduler {
+public:
+    explicit fair_scheduler(const std::vector<subnet_weight> & weights) : weights(weights) {}
+    void push(sched_job *);
+    sched_job * next() { return this->head ? this->head->first : NULL; }
+    void pop();
+    size_t size() const { return this->waiting; }
+private:
+    struct flow {
+        sched_job * first = NULL, * last = NULL;    // requests waiting, oldest first
+        int weight, credit = 0;
+        flow * next = NULL;     // in the round robin, only while jobs are waiting
+    };
+    void append(flow *);
+    int weight_of(uint32_t) const;
+
+    std::unordered_map<uint32_t, flow> flows;
+    std::vector<subnet_weight> weights;
+    flow * head = NULL, * tail = NULL;
+    size_t waiting = 0, active = 0;
+};
+
+scheduler * make_scheduler(const std::string &, const sched_params &, int);
+bool sched_set_option(sched_params &, const std::string &);
+bool sched_add_weight(sched_params &, const std::string &);
+
+#endif
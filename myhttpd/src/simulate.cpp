@@ -0,0 +1,275 @@
+#include "simulate.h"
+
+
+void print_usage(const char * exec) {
+    std::cout   << "\nUSAGE: " << exec << " [Options]\n\n"
+                << "Replays a myhttpd access log through the scheduling policies and prints\n"
+                << "one JSON line for every policy and number of threads.\n\n"
+                << "Options:\n" << "\t-h\t\tPrint a usage summary;\n"
+                << "\t-f <file>\tAccess log to replay. Default: standard input;\n"
+                << "\t-s <policies>\tComma separated policies. Default: " SIM_DEFAULT_POLICIES ";\n"
+                << "\t-n <threads>\tComma separated numbers of workers. Default: " SIM_DEFAULT_THREADS ";\n"
+                << "\t-o <name=value>\tTune scheduling policy, same as myhttpd -o;\n"
+                << "\t-w <net/bits=weight>\tWeight of a subnet under FAIR, same as myhttpd -w;\n"
+                << "\t-Q <count>\tReject requests arriving to this many waiting ones. Default: 0, unbounded;\n"
+                << "\t-D <ms>\tShed requests that waited longer. Default: 0, never;\n"
+                << "\t-c <us>\tService time every request takes. Default: 50;\n"
+                << "\t-b <MB/s>\tRate at which a worker sends response body. Default: 1000;\n"
+                << "\t-x <factor>\tReplay arrivals this many times faster than logged. Default: 1;\n"
+                << "\t-S <ms>\tWait after which a request counts as starved. Default: 1000;\n\n";
+    exit(0);
+}
+
+void parse_args(int ac, char * av[]) {
+    const char * exec_name = av[0];
+    try {
+        for(int i=1; i<ac; i++) {
+            std::string current = av[i];
+            if (current.size() != 2 || current[0] != '-') print_usage(exec_name);
+            switch (current[1]) {
+                case 'f':
+                if (++i >= ac) print_usage(exec_name);
+                sim_params.logfile = av[i];
+                break;
+                case 's':
+                if (++i >= ac) print_usage(exec_name);
+                sim_params.policies = av[i];
+                break;
+                case 'n':
+                if (++i >= ac) print_usage(exec_name);
+                sim_params.threads = av[i];
+                break;
+                case 'o':
+                if (++i >= ac || !sched_set_option(sim_params.sched, av[i])) print_usage(exec_name);
+                break;
+                case 'w':
+                if (++i >= ac || !sched_add_weight(sim_params.sched, av[i])) print_usage(exec_name);
+                break;
+                case 'Q':
+                if (++i >= ac) print_usage(exec_name);
+                sim_params.queue_max = std::stoul(av[i]);
+                break;
+                case 'D':
+                if (++i >= ac) print_usage(exec_name);
+                sim_params.deadline_ms = std::stoi(av[i]);
+                break;
+                case 'c':
+                if (++i >= ac) print_usage(exec_name);
+                sim_params.overhead = std::stod(av[i]);
+                break;
+                case 'b':
+                if (++i >= ac) print_usage(exec_name);
+                sim_params.bandwidth = std::stod(av[i]);
+                break;
+                case 'x':
+                if (++i >= ac) print_usage(exec_name);
+                sim_params.speedup = std::stod(av[i]);
+                break;
+                case 'S':
+                if (++i >= ac) print_usage(exec_name);
+                sim_params.starvation_ms = std::stoi(av[i]);
+                break;
+                default:
+                print_usage(exec_name);
+            }
+        }
+    }
+    catch (const std::exception &) {
+        print_usage(exec_name);
+    }
+    if (sim_params.deadline_ms < 0 || sim_params.overhead < 0 || sim_params.bandwidth <= 0 ||
+        sim_params.speedup <= 0 || sim_params.starvation_ms < 0) print_usage(exec_name);
+}
+
+/*
+ * Reads client, arrival second and response size of a log line:
+ * IP ~ [arrival] [done] "METHOD page HTTP/1.x" status bytes
+ */
+bool parse_log_line(const std::string & line, time_t & second, sim_request & req) {
+    size_t space = line.find(' ');
+    size_t open = line.find('['), close = line.find(']');
+    size_t quote = line.rfind('"');
+    if (space == std::string::npos || open == std::string::npos || close == std::string::npos ||
+        quote == std::string::npos || close < open) return false;
+    struct in_addr addr;
+    if (inet_pton(AF_INET, line.substr(0, space).c_str(), &addr) != 1) return false;
+    req.client = ntohl(addr.s_addr);
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    std::string stamp = line.substr(open + 1, close - open - 1);
+    if (!strptime(stamp.c_str(), "%d/%b/%Y:%H:%M:%S %z", &tm)) return false;
+    second = timegm(&tm) - tm.tm_gmtoff;
+    int status;
+    long long bytes;
+    if (sscanf(line.c_str() + quote + 1, "%d %lld", &status, &bytes) != 2 || bytes < 0) return false;
+    req.bytes = bytes;
+    return true;
+}
+
+/*
+ * Lines are written when requests finish and stamped with whole seconds, so
+ * they are ordered by arrival second and requests of the same second are
+ * spread evenly over it, in the order they were logged.
+ */
+void read_log(std::istream & in, std::vector<sim_request> & out) {
+    std::vector<std::pair<time_t, sim_request>> lines;
+    std::string line;
+    size_t skipped = 0;
+    while (std::getline(in, line)) {
+        std::pair<time_t, sim_request> l;
+        if (parse_log_line(line, l.first, l.second)) lines.push_back(l);
+        else skipped++;
+    }
+    if (skipped) std::cerr << "skipped " << skipped << " malformed log lines\n";
+    std::stable_sort(lines.begin(), lines.end(),
+        [](const std::pair<time_t, sim_request> & a, const std::pair<time_t, sim_request> & b) { return a.first < b.first; });
+    for (size_t i = 0; i < lines.size(); ) {
+        size_t end = i;
+        while (end < lines.size() && lines[end].first == lines[i].first) end++;
+        for (size_t j = i; j < end; j++) {
+            sim_request req = lines[j].second;
+            double offset = (lines[i].first - lines[0].first) * 1e6 + (j - i) * 1e6 / (end - i);
+            req.arrival = (uint64_t)(offset / sim_params.speedup);
+            out.push_back(req);
+        }
+        i = end;
+    }
+}
+
+std::vector<std::string> split_list(const std::string & list) {
+    std::vector<std::string> items;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        if (!item.empty()) items.push_back(item);
+    return items;
+}
+
+/* Worker time of a response in us: fixed cost plus its body at the modeled bandwidth */
+uint64_t service_time(off_t bytes) {
+    return (uint64_t)(sim_params.overhead + bytes / sim_params.bandwidth);
+}
+
+/*
+ * Discrete event simulation of a shard: requests arrive as logged, wait in the
+ * policy's queue and run on the first idle worker until their service time is
+ * over. Completions at a moment are handled before arrivals, both before
+ * dispatch, same as the reactor collects before it feeds workers. Nothing
+ * depends on the clock of the machine, every run gives the same numbers.
+ */
+sim_result simulate(const std::vector<sim_request> & trace, const std::string & policy, int threads) {
+    sim_result r;
+    std::unique_ptr<scheduler> sched(make_scheduler(policy, sim_params.sched, threads));
+    std::vector<sim_job> jobs(trace.size());
+    typedef std::pair<uint64_t, size_t> completion;     // us, index of the job
+    std::priority_queue<completion, std::vector<completion>, std::greater<completion>> running;
+    uint64_t last = 0, deadline = (uint64_t)sim_params.deadline_ms * 1000;
+    uint64_t starvation = (uint64_t)sim_params.starvation_ms * 1000;
+    size_t arrived = 0;
+    int idle = threads;
+    r.latencies.reserve(trace.size());
+    r.waits.reserve(trace.size());
+    while (arrived < trace.size() || !running.empty()) {
+        uint64_t now = arrived < trace.size() ? trace[arrived].arrival : UINT64_MAX;
+        if (!running.empty()) now = std::min(now, running.top().first);
+        r.depth_area += (double)sched->size() * (now - last);
+        last = now;
+        while (!running.empty() && running.top().first == now) {
+            sched->done(&jobs[running.top().second]);
+            running.pop();
+            idle++;
+        }
+        while (arrived < trace.size() && trace[arrived].arrival == now) {
+            const sim_request & req = trace[arrived];
+            sim_job & job = jobs[arrived];
+            job.seq = arrived++;
+            job.arrival_us = req.arrival;
+            job.arrived = req.arrival / 1000;
+            job.size = req.bytes;
+            job.client = req.client;
+            if (sim_params.queue_max && sched->size() >= sim_params.queue_max) {
+                r.rejected++;
+                continue;
+            }
+            sched->push(&job);
+        }
+        r.depth_max = std::max(r.depth_max, sched->size());
+        sim_job * job;
+        while (idle && (job = static_cast<sim_job *>(sched->next()))) {
+            sched->pop();
+            uint64_t wait = now - job->arrival_us;
+            if (deadline && wait > deadline) {
+                sched->done(job);
+                r.shed++;
+                continue;
+            }
+            uint64_t service = service_time(job->size);
+            running.push(completion(now + service, job->seq));
+            idle--;
+            r.waits.push_back((uint32_t)std::min<uint64_t>(wait, UINT32_MAX));
+            r.latencies.push_back((uint32_t)std::min<uint64_t>(wait + service, UINT32_MAX));
+            if (wait > starvation) r.starved++;
+            r.end = std::max(r.end, now + service);
+        }
+    }
+    return r;
+}
+
+/* Nearest-rank percentile of sorted samples */
+uint32_t percentile(const std::vector<uint32_t> & sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.999999);
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+void print_result(const std::string & policy, int threads, sim_result & r) {
+    uint64_t sum = 0;
+    for (uint32_t l : r.latencies) sum += l;
+    std::sort(r.latencies.begin(), r.latencies.end());
+    std::sort(r.waits.begin(), r.waits.end());
+    const std::vector<uint32_t> & all = r.latencies;
+    printf("{\"policy\":\"%s\",\"threads\":%d,\"served\":%zu,\"rejected\":%llu,\"shed\":%llu,\"makespan\":%.3f,"
+           "\"latency_us\":{\"mean\":%.1f,\"p50\":%u,\"p90\":%u,\"p99\":%u,\"p99.9\":%u,\"max\":%u},"
+           "\"wait_us\":{\"p50\":%u,\"p99\":%u,\"max\":%u},\"queue\":{\"mean\":%.2f,\"max\":%zu},\"starved\":%llu}\n",
+           policy.c_str(), threads, all.size(), (unsigned long long)r.rejected, (unsigned long long)r.shed, r.end / 1e6,
+           all.empty() ? 0.0 : (double)sum / all.size(),
+           percentile(all, 50), percentile(all, 90), percentile(all, 99), percentile(all, 99.9), all.empty() ? 0 : all.back(),
+           percentile(r.waits, 50), percentile(r.waits, 99), r.waits.empty() ? 0 : r.waits.back(),
+           r.end ? r.depth_area / r.end : 0.0, r.depth_max, (unsigned long long)r.starved);
+}
+
+int main(int argc, char * argv[]) {
+    parse_args(argc, argv);
+    std::vector<sim_request> trace;
+    if (sim_params.logfile.empty()) read_log(std::cin, trace);
+    else {
+        std::ifstream in(sim_params.logfile);
+        if (!in) {
+            std::cerr << "cannot open " << sim_params.logfile << "\n";
+            return 1;
+        }
+        read_log(in, trace);
+    }
+    std::vector<std::string> policies = split_list(sim_params.policies);
+    std::vector<int> threads;
+    try {
+        for (const std::string & n : split_list(sim_params.threads)) threads.push_back(std::stoi(n));
+    }
+    catch (const std::exception &) {
+        print_usage(argv[0]);
+    }
+    for (const std::string & policy : policies) {
+        std::unique_ptr<scheduler> probe(make_scheduler(policy, sim_params.sched, 1));
+        if (!probe) {
+            std::cerr << "unknown policy " << policy << "\n";
+            return 1;
+        }
+    }
+    for (int n : threads) if (n < 1) print_usage(argv[0]);
+    for (const std::string & policy : policies)
+        for (int n : threads) {
+            sim_result r = simulate(trace, policy, n);
+            print_result(policy, n, r);
+        }
+    return 0;
+}
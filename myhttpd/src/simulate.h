@@ -0,0 +1,72 @@
+#ifndef SIMULATE_H
+#define SIMULATE_H
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <arpa/inet.h>
+#include "scheduler.h"
+
+/* Defaults of the simulator */
+#define SIM_DEFAULT_POLICIES                "FCFS,SJF,SRPT,EDF,SPLIT,FAIR"
+#define SIM_DEFAULT_THREADS                 "1,2,4,8"
+#define SIM_DEFAULT_OVERHEAD                50      // us every request costs
+#define SIM_DEFAULT_BANDWIDTH               1000    // MB/s a worker sends at
+#define SIM_DEFAULT_STARVATION              1000    // ms of waiting counted as starved
+
+/* Structure holds parameters of a simulation */
+static struct sim_parameters {
+    std::string logfile;                // standard input when empty
+    std::string policies = SIM_DEFAULT_POLICIES;
+    std::string threads = SIM_DEFAULT_THREADS;
+    double overhead = SIM_DEFAULT_OVERHEAD;
+    double bandwidth = SIM_DEFAULT_BANDWIDTH;
+    double speedup = 1;                 // arrivals are this many times denser than logged
+    size_t queue_max = 0;               // like myhttpd -Q, 0 is unbounded
+    int deadline_ms = 0;                // like myhttpd -D
+    int starvation_ms = SIM_DEFAULT_STARVATION;
+    sched_params sched;
+} sim_params;
+
+/* Request read from the access log */
+struct sim_request {
+    uint64_t arrival;       // us since the first logged second
+    off_t bytes;
+    uint32_t client;
+};
+
+/* Replayed request, scheduler orders it like the server orders http_request */
+struct sim_job : public sched_job {
+    uint64_t arrival_us;
+};
+
+/* Outcome of one policy and pool size */
+struct sim_result {
+    std::vector<uint32_t> latencies, waits;     // us, of served requests
+    uint64_t rejected = 0, shed = 0, starved = 0;
+    uint64_t end = 0;                           // us when the last request finished
+    double depth_area = 0;                      // queue depth integrated over time, us
+    size_t depth_max = 0;
+};
+
+void print_usage(const char *);
+void parse_args(int, char *[]);
+bool parse_log_line(const std::string &, time_t &, sim_request &);
+void read_log(std::istream &, std::vector<sim_request> &);
+std::vector<std::string> split_list(const std::string &);
+sim_result simulate(const std::vector<sim_request> &, const std::string &, int);
+uint64_t service_time(off_t);
+uint32_t percentile(const std::vector<uint32_t> &, double);
+void print_result(const std::string &, int, sim_result &);
+
+#endif
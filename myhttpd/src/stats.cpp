@@ -0,0 +1,218 @@
+#include "stats.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+
+#ifdef COUNT_ALLOCATIONS
+
+static std::atomic<uint64_t> allocations(0);
+
+uint64_t allocation_count() { return allocations.load(std::memory_order_relaxed); }
+
+/* Every other form of operator new is implemented by the library in terms of these */
+void * operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void * p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void * p) noexcept { free(p); }
+
+#endif
+
+#ifdef SERVER_STATS
+
+server_stats stats;
+thread_local thread_stats * local_stats = NULL;
+
+
+/* Values below 16 ns get a bucket each, above that every power of two is split in 16 */
+int histogram::bucket_of(uint64_t v) {
+    if (v < STATS_SUB_BUCKETS) return v;
+    int e = 63 - __builtin_clzll(v);
+    if (e > STATS_MAX_EXPONENT) return STATS_BUCKETS - 1;
+    return (e - STATS_SUB_BITS + 1) * STATS_SUB_BUCKETS + ((v >> (e - STATS_SUB_BITS)) & (STATS_SUB_BUCKETS - 1));
+}
+
+/* Middle of the range bucket covers */
+uint64_t histogram::bucket_value(int i) {
+    if (i < STATS_SUB_BUCKETS) return i;
+    int shift = i / STATS_SUB_BUCKETS - 1;
+    uint64_t low = (uint64_t)(STATS_SUB_BUCKETS + i % STATS_SUB_BUCKETS) << shift;
+    return low + ((1ULL << shift) >> 1);
+}
+
+void server_stats::init(int producers) {
+    /* Value-initialization zeroes the counters */
+    this->per_thread = new thread_stats[producers]();
+    this->producers = producers;
+    this->started = time(0);
+    this->queue_depth = this->open_connections = 0;
+    this->accepted = 0;
+}
+
+/* Merges the stage over all threads and reads percentiles from cumulative counts */
+server_stats::summary server_stats::summarize(stats_stage stage) const {
+    static thread_local uint64_t merged[STATS_BUCKETS];
+    summary s = {0, 0, 0, 0, 0, 0, 0};
+    uint64_t sum = 0;
+    for (int b=0; b<STATS_BUCKETS; b++) merged[b] = 0;
+    for (int t=0; t<this->producers; t++) {
+        const histogram & h = this->per_thread[t].stages[stage];
+        for (int b=0; b<STATS_BUCKETS; b++) merged[b] += h.counts[b].load(std::memory_order_relaxed);
+        sum += h.sum.load(std::memory_order_relaxed);
+        s.max = std::max<uint64_t>(s.max, h.max.load(std::memory_order_relaxed));
+    }
+    for (int b=0; b<STATS_BUCKETS; b++) s.count += merged[b];
+    if (!s.count) return s;
+    s.mean = sum / s.count;
+    const double ranks[4] = {0.5, 0.9, 0.99, 0.999};
+    uint64_t * out[4] = {&s.p50, &s.p90, &s.p99, &s.p999};
+    uint64_t seen = 0;
+    int r = 0;
+    for (int b=0; b<STATS_BUCKETS && r<4; b++) {
+        seen += merged[b];
+        while (r < 4 && seen >= ranks[r] * s.count) *out[r++] = std::min(histogram::bucket_value(b), s.max);
+    }
+    return s;
+}
+
+uint64_t server_stats::bytes_sent() const {
+    uint64_t total = 0;
+    for (int t=0; t<this->producers; t++) total += this->per_thread[t].bytes_sent.load(std::memory_order_relaxed);
+    return total;
+}
+
+uint64_t server_stats::status_count(int code) const {
+    uint64_t total = 0;
+    for (int t=0; t<this->producers; t++) total += this->per_thread[t].status[code].load(std::memory_order_relaxed);
+    return total;
+}
+
+void server_stats::pool_changed(const pool_event & ev) {
+    std::lock_guard<std::mutex> lg(this->pool_mutex);
+    uint64_t seq = this->pool_grown + this->pool_retired;
+    this->pool_events[seq % STATS_POOL_EVENTS] = ev;
+    if (ev.grown) this->pool_grown++;
+    else this->pool_retired++;
+}
+
+/* Copies recorded pool changes oldest first */
+void server_stats::pool_history(pool_event * out, int & count, uint64_t & grown, uint64_t & retired) const {
+    std::lock_guard<std::mutex> lg(this->pool_mutex);
+    grown = this->pool_grown;
+    retired = this->pool_retired;
+    uint64_t total = grown + retired;
+    count = std::min<uint64_t>(total, STATS_POOL_EVENTS);
+    for (int i=0; i<count; i++) out[i] = this->pool_events[(total - count + i) % STATS_POOL_EVENTS];
+}
+
+static const char * stage_names[STAGE_COUNT] = {"queue", "stat", "content", "header", "send", "total"};
+
+void server_stats::render_text(std::string & out, int threads, int ready, const cache_counters & cache) const {
+    char line[256];
+    snprintf(line, sizeof(line),
+             "Uptime: %ld s\nConnections: %d open, %llu accepted\nQueue depth: %d\n"
+             "Workers: %d busy of %d\nBytes sent: %llu\n",
+             (long)(time(0) - this->started), this->open_connections.load(),
+             (unsigned long long)this->accepted.load(), this->queue_depth.load(), threads - ready, threads,
+             (unsigned long long)this->bytes_sent());
+    out.append(line);
+#ifdef COUNT_ALLOCATIONS
+    snprintf(line, sizeof(line), "Allocations: %llu\n", (unsigned long long)allocation_count());
+    out.append(line);
+#endif
+    for (int code=0; code<STATS_STATUS_CODES; code++) {
+        uint64_t n = this->status_count(code);
+        if (!n) continue;
+        snprintf(line, sizeof(line), "Status %d: %llu\n", code, (unsigned long long)n);
+        out.append(line);
+    }
+    snprintf(line, sizeof(line), "Cache: %llu hits, %llu misses, %llu evictions, %llu coalesced, %zu entries, %zu/%zu bytes\n",
+             (unsigned long long)cache.hits, (unsigned long long)cache.misses, (unsigned long long)cache.evictions,
+             (unsigned long long)cache.coalesced, cache.entries, cache.used, cache.capacity);
+    out.append(line);
+    out.append("\nStage (us)      count       mean        p50        p90        p99      p99.9        max\n");
+    for (int i=0; i<STAGE_COUNT; i++) {
+        summary s = this->summarize((stats_stage)i);
+        snprintf(line, sizeof(line), "%-10s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", stage_names[i],
+                 (unsigned long long)s.count, s.mean / 1e3, s.p50 / 1e3, s.p90 / 1e3, s.p99 / 1e3,
+                 s.p999 / 1e3, s.max / 1e3);
+        out.append(line);
+    }
+    pool_event events[STATS_POOL_EVENTS];
+    int count;
+    uint64_t grown, retired;
+    this->pool_history(events, count, grown, retired);
+    snprintf(line, sizeof(line), "\nPool: %llu grown, %llu retired\n", (unsigned long long)grown,
+             (unsigned long long)retired);
+    out.append(line);
+    if (count) out.append("Time                      shard  change  workers  busy  wait (ms)\n");
+    for (int i=0; i<count; i++) {
+        struct tm t;
+        char when[32];
+        strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime_r(&events[i].when, &t));
+        snprintf(line, sizeof(line), "%-25s %5d  %-6s  %7d  %4d  %9llu\n", when, events[i].shard,
+                 events[i].grown ? "grow" : "retire", events[i].workers, events[i].busy,
+                 (unsigned long long)events[i].wait_ms);
+        out.append(line);
+    }
+}
+
+void server_stats::render_json(std::string & out, int threads, int ready, const cache_counters & cache) const {
+    char line[256];
+    snprintf(line, sizeof(line),
+             "{\"uptime\":%ld,\"open_connections\":%d,\"accepted\":%llu,\"queue_depth\":%d,"
+             "\"busy_workers\":%d,\"workers\":%d,\"bytes_sent\":%llu,",
+             (long)(time(0) - this->started), this->open_connections.load(),
+             (unsigned long long)this->accepted.load(), this->queue_depth.load(), threads - ready, threads,
+             (unsigned long long)this->bytes_sent());
+    out.append(line);
+#ifdef COUNT_ALLOCATIONS
+    snprintf(line, sizeof(line), "\"allocations\":%llu,", (unsigned long long)allocation_count());
+    out.append(line);
+#endif
+    out.append("\"status\":{");
+    const char * sep = "";
+    for (int code=0; code<STATS_STATUS_CODES; code++) {
+        uint64_t n = this->status_count(code);
+        if (!n) continue;
+        snprintf(line, sizeof(line), "%s\"%d\":%llu", sep, code, (unsigned long long)n);
+        out.append(line);
+        sep = ",";
+    }
+    snprintf(line, sizeof(line), "},\"cache\":{\"hits\":%llu,\"misses\":%llu,\"evictions\":%llu,\"coalesced\":%llu,"
+             "\"entries\":%zu,\"bytes\":%zu,\"capacity\":%zu", (unsigned long long)cache.hits,
+             (unsigned long long)cache.misses, (unsigned long long)cache.evictions,
+             (unsigned long long)cache.coalesced, cache.entries, cache.used, cache.capacity);
+    out.append(line);
+    out.append("},\"stages_ns\":{");
+    for (int i=0; i<STAGE_COUNT; i++) {
+        summary s = this->summarize((stats_stage)i);
+        snprintf(line, sizeof(line),
+                 "%s\"%s\":{\"count\":%llu,\"mean\":%llu,\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,"
+                 "\"p99.9\":%llu,\"max\":%llu}", i ? "," : "", stage_names[i], (unsigned long long)s.count,
+                 (unsigned long long)s.mean, (unsigned long long)s.p50, (unsigned long long)s.p90,
+                 (unsigned long long)s.p99, (unsigned long long)s.p999, (unsigned long long)s.max);
+        out.append(line);
+    }
+    pool_event events[STATS_POOL_EVENTS];
+    int count;
+    uint64_t grown, retired;
+    this->pool_history(events, count, grown, retired);
+    snprintf(line, sizeof(line), "},\"pool\":{\"grown\":%llu,\"retired\":%llu,\"events\":[",
+             (unsigned long long)grown, (unsigned long long)retired);
+    out.append(line);
+    for (int i=0; i<count; i++) {
+        snprintf(line, sizeof(line), "%s{\"time\":%ld,\"shard\":%d,\"change\":\"%s\",\"workers\":%d,"
+                 "\"busy\":%d,\"wait_ms\":%llu}", i ? "," : "", (long)events[i].when, events[i].shard,
+                 events[i].grown ? "grow" : "retire", events[i].workers, events[i].busy,
+                 (unsigned long long)events[i].wait_ms);
+        out.append(line);
+    }
+    out.append("]}}\n");
+}
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <time.h>
+
+/*
+ * Instrumentation is compiled in unless built with -DNO_SERVER_STATS.
+ * Every hook in the server is wrapped in STATS() so it disappears entirely.
+ */
+#ifndef NO_SERVER_STATS
+#define SERVER_STATS
+#define STATS(stmt)                         stmt
+#else
+#define STATS(stmt)
+#endif
+
+/*
+ * Built with -DCOUNT_ALLOCATIONS the server replaces global operator new and
+ * reports how many times it was called, see allocs.sh. Counting costs an atomic
+ * increment per allocation so it isn't part of the normal build
+ */
+#ifdef COUNT_ALLOCATIONS
+uint64_t allocation_count();
+#endif
+
+/* Histogram keeps 16 sub-buckets per power of two, relative error is below 6.25% */
+#define STATS_SUB_BITS                      4
+#define STATS_SUB_BUCKETS                   (1 << STATS_SUB_BITS)
+/* Largest exponent tracked, 2^40 ns is about 18 minutes */
+#define STATS_MAX_EXPONENT                  40
+#define STATS_BUCKETS                       ((STATS_MAX_EXPONENT - STATS_SUB_BITS + 2) * STATS_SUB_BUCKETS)
+/* Status codes are counted in a table indexed by the code */
+#define STATS_STATUS_CODES                  600
+/* Latest worker pool changes shown on the status page */
+#define STATS_POOL_EVENTS                   32
+
+/* Stages of a request. Stat is measured inside content lookup and counted in both */
+enum stats_stage {
+    STAGE_QUEUE,            // dispatched by the reactor until taken by a worker
+    STAGE_STAT,             // stat() of the requested path, on the reactor and in the worker
+    STAGE_CONTENT,          // content lookup: stat, cache, open, read, directory listing
+    STAGE_HEADER,           // building response header
+    STAGE_SEND,             // writing header and body to the socket
+    STAGE_TOTAL,            // dispatched until response is sent
+    STAGE_COUNT
+};
+
+/*
+ * Log-linear latency histogram in nanoseconds. It has a single writer, so
+ * recording is a relaxed load and store. Readers may see a record half done,
+ * which only skews a snapshot by one sample.
+ */
+class histogram {
+public:
+    void record(uint64_t ns) {
+        bump(this->counts[bucket_of(ns)], 1);
+        bump(this->sum, ns);
+        if (ns > this->max.load(std::memory_order_relaxed)) this->max.store(ns, std::memory_order_relaxed);
+    }
+    static int bucket_of(uint64_t);
+    static uint64_t bucket_value(int);
+
+    std::atomic<uint64_t> counts[STATS_BUCKETS];
+    std::atomic<uint64_t> sum, max;
+private:
+    static void bump(std::atomic<uint64_t> & a, uint64_t v) {
+        a.store(a.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+};
+
+/* Everything one thread records. Padding keeps neighbouring threads off each other's cache lines */
+struct thread_stats {
+    histogram stages[STAGE_COUNT];
+    std::atomic<uint64_t> bytes_sent;
+    std::atomic<uint64_t> status[STATS_STATUS_CODES];
+    char pad[64];
+};
+
+/* Snapshot of the content cache's counters, taken under its lock */
+struct cache_counters {
+    uint64_t hits = 0, misses = 0, evictions = 0, coalesced = 0;
+    size_t entries = 0, used = 0, capacity = 0;
+};
+
+/* Worker added to or retired from a shard's pool */
+struct pool_event {
+    time_t when;
+    int shard;
+    bool grown;
+    int workers;            // pool size after the change
+    int busy;               // workers serving requests when it was decided
+    uint64_t wait_ms;       // how long the next request had waited, 0 for retirement
+};
+
+class server_stats {
+public:
+    void init(int);
+    thread_stats & at(int id) { return this->per_thread[id]; }
+    /* Workers are described by pool size and the number of idle ones, cache by its counters */
+    void render_text(std::string &, int, int, const cache_counters &) const;
+    void render_json(std::string &, int, int, const cache_counters &) const;
+    /* Pool changes are rare and come from the reactor and workers alike, a lock is enough */
+    void pool_changed(const pool_event &);
+
+    /* Gauges published by the reactor */
+    std::atomic<int> queue_depth, open_connections;
+    std::atomic<uint64_t> accepted;
+private:
+    struct summary {
+        uint64_t count, mean, p50, p90, p99, p999, max;
+    };
+    summary summarize(stats_stage) const;
+    uint64_t bytes_sent() const;
+    uint64_t status_count(int) const;
+    void pool_history(pool_event *, int &, uint64_t &, uint64_t &) const;
+
+    thread_stats * per_thread = NULL;
+    int producers = 0;
+    time_t started = 0;
+    mutable std::mutex pool_mutex;
+    pool_event pool_events[STATS_POOL_EVENTS];  // ring, oldest is overwritten
+    uint64_t pool_grown = 0, pool_retired = 0;
+};
+
+#ifdef SERVER_STATS
+extern server_stats stats;
+extern thread_local thread_stats * local_stats;
+
+/* Every thread that records binds its own slot first */
+inline void stats_bind(int id) { local_stats = &stats.at(id); }
+
+inline uint64_t stats_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Records time since given mark and returns the new mark, so consecutive stages chain */
+inline uint64_t stats_record(stats_stage stage, uint64_t since) {
+    uint64_t now = stats_now();
+    local_stats->stages[stage].record(now - since);
+    return now;
+}
+
+inline void stats_response(int status) {
+    std::atomic<uint64_t> & s = local_stats->status[status >= 0 && status < STATS_STATUS_CODES ? status : 0];
+    s.store(s.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+/* Called with what every send call returned, so partial and failed responses count only bytes that left */
+inline void stats_sent(uint64_t bytes) {
+    local_stats->bytes_sent.store(local_stats->bytes_sent.load(std::memory_order_relaxed) + bytes,
+                                  std::memory_order_relaxed);
+}
+#endif
+
+#endif
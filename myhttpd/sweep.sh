@@ -0,0 +1,32 @@
+#!/bin/sh
+#
+# Runs loadgen against a fresh myhttpd for every combination of worker count
+# and scheduling policy. Prints one JSON object per run:
+#   {"threads":N,"policy":"FCFS","result":{...loadgen report...}}
+#
+# Environment: THREADS (default "1 2 4 8"), POLICIES (default "FCFS SJF SRPT EDF SPLIT FAIR"),
+# PORT (first port used, every run takes the next one so a closing server
+# never blocks the following run), LOADGEN_ARGS (passed to loadgen as is).
+#
+
+THREADS=${THREADS:-"1 2 4 8"}
+POLICIES=${POLICIES:-"FCFS SJF SRPT EDF SPLIT FAIR"}
+PORT=${PORT:-18100}
+LOADGEN_ARGS=${LOADGEN_ARGS:-"-c 32 -d 10"}
+
+cd "$(dirname "$0")" || exit 1
+for bin in ./myhttpd ./loadgen; do
+    [ -x "$bin" ] || { echo "$bin is missing, run make first" >&2; exit 1; }
+done
+
+for policy in $POLICIES; do
+    for threads in $THREADS; do
+        ./myhttpd -p "$PORT" -t 0 -n "$threads" -s "$policy"
+        sleep 1
+        pid=$(pgrep -n -f "myhttpd -p $PORT ")
+        result=$(./loadgen -p "$PORT" $LOADGEN_ARGS)
+        [ -n "$pid" ] && kill "$pid"
+        printf '{"threads":%s,"policy":"%s","result":%s}\n' "$threads" "$policy" "${result:-null}"
+        PORT=$((PORT + 1))
+    done
+done